@@ -0,0 +1,100 @@
+#include "baseline.h"
+
+#include "json.h"
+
+void SaveBaseline(const std::string& path, const Baseline& baseline) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        throw "failed to create baseline file";
+    }
+    fprintf(out, "{\n  \"config\": ");
+    WriteJsonString(out, baseline.Config);
+    fprintf(out, ",\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < baseline.Results.size(); ++i) {
+        const auto& r = baseline.Results[i];
+        fprintf(out, "    {\"name\": ");
+        WriteJsonString(out, r.Name);
+        fprintf(out, ", \"bytes\": %llu, \"files\": %llu, \"seconds\": [",
+                static_cast<unsigned long long>(r.Amount.Bytes),
+                static_cast<unsigned long long>(r.Amount.Files));
+        for (size_t k = 0; k < r.Seconds.size(); ++k) {
+            fprintf(out, "%s%.9f", k > 0 ? ", " : "", r.Seconds[k]);
+        }
+        fprintf(out, "]}%s\n", i + 1 < baseline.Results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    bool ok = !ferror(out);
+    if (fclose(out) != 0 || !ok) {
+        throw "failed to write baseline file";
+    }
+}
+
+Baseline LoadBaseline(const std::string& path) {
+    JsonValue root = ReadJsonFile(path);
+    Baseline baseline;
+    baseline.Config = root.StringOr("config", "");
+    const JsonValue* benchmarks = root.Find("benchmarks");
+    if (!benchmarks || benchmarks->Kind != JsonValue::Type::Array) {
+        throw "baseline has no benchmarks";
+    }
+    for (const auto& b : benchmarks->Array) {
+        BenchResult r;
+        r.Name = b.StringOr("name", "");
+        r.Amount.Bytes = static_cast<uint64_t>(b.NumberOr("bytes", 0));
+        r.Amount.Files = static_cast<uint64_t>(b.NumberOr("files", 0));
+        if (const JsonValue* seconds = b.Find("seconds")) {
+            for (const auto& s : seconds->Array) {
+                r.Seconds.push_back(s.Number);
+            }
+        }
+        if (r.Name.empty() || r.Seconds.empty()) {
+            throw "malformed baseline entry";
+        }
+        baseline.Results.push_back(std::move(r));
+    }
+    return baseline;
+}
+
+size_t CompareWithBaseline(FILE* out, const Baseline& baseline, const Baseline& current,
+                           double threshold) {
+    if (baseline.Config != current.Config) {
+        fprintf(out, "warning: the baseline was taken with a different workload\n");
+        fprintf(out, "  baseline: %s\n  current:  %s\n", baseline.Config.c_str(),
+                current.Config.c_str());
+    }
+
+    size_t regressions = 0;
+    fprintf(out, "%-12s %20s %20s %9s  %s\n", "benchmark", "baseline", "current", "change",
+            "verdict");
+    for (const auto& r : current.Results) {
+        const BenchResult* base = nullptr;
+        for (const auto& b : baseline.Results) {
+            if (b.Name == r.Name) {
+                base = &b;
+            }
+        }
+        BenchInterval now = ConfidenceInterval(Throughputs(r));
+        if (!base) {
+            fprintf(out, "%-12s %20s %11.1f +- %5.1f %9s  new\n", r.Name.c_str(), "-", now.Mean,
+                    now.HalfWidth, "-");
+            continue;
+        }
+
+        BenchInterval before = ConfidenceInterval(Throughputs(*base));
+        double change = before.Mean > 0 ? now.Mean / before.Mean - 1.0 : 0.0;
+        bool disjoint = now.Mean + now.HalfWidth < before.Mean - before.HalfWidth
+                        || now.Mean - now.HalfWidth > before.Mean + before.HalfWidth;
+        const char* verdict = "same";
+        if (disjoint && change < -threshold) {
+            verdict = "REGRESSED";
+            ++regressions;
+        } else if (disjoint && change > threshold) {
+            verdict = "improved";
+        } else if (!disjoint && (change < -threshold || change > threshold)) {
+            verdict = "noisy";
+        }
+        fprintf(out, "%-12s %11.1f +- %5.1f %11.1f +- %5.1f %+8.1f%%  %s\n", r.Name.c_str(),
+                before.Mean, before.HalfWidth, now.Mean, now.HalfWidth, change * 100.0, verdict);
+    }
+    return regressions;
+}
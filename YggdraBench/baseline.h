@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+// A saved run of the suite. Config records the workload options so that a comparison against a
+// baseline taken with a different workload can be called out.
+struct Baseline {
+    std::string Config;
+    std::vector<BenchResult> Results;
+};
+
+// Stores the per-run times as JSON. Throws if the file can't be written.
+void SaveBaseline(const std::string& path, const Baseline& baseline);
+Baseline LoadBaseline(const std::string& path);
+
+// Prints each benchmark's throughput against the baseline. A benchmark has regressed when its
+// mean throughput dropped by more than threshold (0.05 for 5%) and the confidence intervals of
+// the two runs don't overlap, so noise alone doesn't flag it. Returns the number of regressions.
+size_t CompareWithBaseline(FILE* out, const Baseline& baseline, const Baseline& current,
+                           double threshold);
@@ -0,0 +1,482 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "archive.h"
+#include "baseline.h"
+#include "bench.h"
+#include "fileio.h"
+#include "md5.h"
+#include "md5generic.h"
+#include "synthetic.h"
+#include "zlib.h"
+
+namespace {
+struct BenchOptions {
+    size_t Iterations = 5;
+    size_t Warmup = 1;
+    size_t KernelSize = 32 * 1024 * 1024;
+    std::vector<std::string> Only;
+};
+
+double Median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+bool Selected(const BenchOptions& options, std::string_view name) {
+    return options.Only.empty()
+           || std::find(options.Only.begin(), options.Only.end(), name) != options.Only.end();
+}
+
+// The whole buffer through one MD5 implementation, in appends that fit its int length.
+void HashBuffer(const std::vector<char>& data, void (*init)(md5_state_t*),
+                void (*append)(md5_state_t*, const md5_byte_t*, int),
+                void (*finish)(md5_state_t*, md5_byte_t*)) {
+    md5_state_t md5;
+    md5_byte_t digest[16];
+    init(&md5);
+    for (size_t i = 0; i < data.size(); i += 0x4000'0000) {
+        size_t n = std::min<size_t>(data.size() - i, 0x4000'0000);
+        append(&md5, (const md5_byte_t*)data.data() + i, static_cast<int>(n));
+    }
+    finish(&md5, digest);
+}
+
+// prepare runs before every iteration and isn't timed, e.g. to clear the previous output.
+BenchResult RunBenchmark(const char* name, const BenchOptions& options,
+                         const std::function<void()>& prepare,
+                         const std::function<BenchAmount()>& run) {
+    BenchResult result;
+    result.Name = name;
+    for (size_t i = 0; i < options.Warmup + options.Iterations; ++i) {
+        if (prepare) {
+            prepare();
+        }
+        auto start = std::chrono::steady_clock::now();
+        result.Amount = run();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (i >= options.Warmup) {
+            result.Seconds.push_back(elapsed.count());
+        }
+    }
+    return result;
+}
+
+void PrintResults(const std::vector<BenchResult>& results) {
+    printf("%-12s %5s %10s %10s %10s %12s\n", "benchmark", "runs", "median s", "min s", "MB/s",
+           "files/s");
+    for (const auto& r : results) {
+        double median = Median(r.Seconds);
+        double min = *std::min_element(r.Seconds.begin(), r.Seconds.end());
+        double mb = static_cast<double>(r.Amount.Bytes) / (1024.0 * 1024.0);
+        printf("%-12s %5zu %10.4f %10.4f %10.1f", r.Name.c_str(), r.Seconds.size(), median, min,
+               median > 0 ? mb / median : 0.0);
+        if (r.Amount.Files > 0) {
+            printf(" %12.0f", median > 0 ? static_cast<double>(r.Amount.Files) / median : 0.0);
+        }
+        printf("\n");
+    }
+}
+
+// accepts a plain byte count or one with a K, M or G suffix
+bool ParseSize(std::string_view s, uint64_t& size) {
+    char* end = nullptr;
+    std::string str(s);
+    unsigned long long value = strtoull(str.c_str(), &end, 10);
+    if (end == str.c_str()) {
+        return false;
+    }
+    const char* units = "KMG";
+    for (int shift = 10; *units; ++units, shift += 10) {
+        if (*end == *units || *end == *units - 'A' + 'a') {
+            value <<= shift;
+            ++end;
+            break;
+        }
+    }
+    size = value;
+    return *end == '\0';
+}
+
+// fixed:SIZE, uniform:MIN-MAX or lognormal:MEDIAN-MAX
+bool ParseSizes(std::string_view s, SyntheticOptions& options) {
+    size_t colon = s.find(':');
+    if (colon == std::string_view::npos) {
+        return false;
+    }
+    std::string_view kind = s.substr(0, colon);
+    std::string_view range = s.substr(colon + 1);
+    if (kind == "fixed") {
+        options.Sizes = SizeDistribution::Fixed;
+        if (!ParseSize(range, options.MedianSize)) {
+            return false;
+        }
+        options.MinSize = options.MaxSize = options.MedianSize;
+        return true;
+    }
+    size_t dash = range.find('-');
+    if (dash == std::string_view::npos) {
+        return false;
+    }
+    uint64_t low = 0;
+    uint64_t high = 0;
+    if (!ParseSize(range.substr(0, dash), low) || !ParseSize(range.substr(dash + 1), high)
+        || low > high) {
+        return false;
+    }
+    if (kind == "uniform") {
+        options.Sizes = SizeDistribution::Uniform;
+        options.MinSize = low;
+        options.MaxSize = high;
+        return true;
+    }
+    if (kind == "lognormal") {
+        options.Sizes = SizeDistribution::LogNormal;
+        options.MinSize = 0;
+        options.MedianSize = low;
+        options.MaxSize = high;
+        return true;
+    }
+    return false;
+}
+
+void PrintUsage() {
+    printf("Usage: YggdraBench [options] [workfolder]\n");
+    printf("Generates a synthetic folder tree and archive in workfolder and times the\n");
+    printf("crypt, compress, decompress, pack and extract benchmarks.\n");
+    printf("Options:\n");
+    printf("  --files=N                number of files in the tree (1000)\n");
+    printf("  --fanout=N               entries per folder (32)\n");
+    printf("  --sizes=fixed:S|uniform:MIN-MAX|lognormal:MEDIAN-MAX\n");
+    printf("                           file size distribution (lognormal:16K-4M)\n");
+    printf("  --compressibility=F      0 for random bytes up to 1 for repetitive text (0.5)\n");
+    printf("  --stored-share=F         share of files stored without compression (0.1)\n");
+    printf("  --seed=N                 seed for the generated tree (1)\n");
+    printf("  --profile=F.json         shape the tree after a YggdraDecode --profile\n");
+    printf("                           (--files still scales it)\n");
+    printf("  --kernel-size=S          buffer size for crypt, compress and decompress (32M)\n");
+    printf("  --iterations=N           measured runs per benchmark (5)\n");
+    printf("  --warmup=N               unmeasured runs before those (1)\n");
+    printf("  --only=a,b,...           run only the named benchmarks\n");
+    printf("  --io=sync|threads|uring  I/O backend for pack and extract\n");
+    printf("  --order=table|offset     extraction order\n");
+    printf("  --save-baseline=F.json   store the results as a baseline\n");
+    printf("  --compare=F.json         compare against a baseline and fail on regressions\n");
+    printf("  --threshold=F            slowdown that counts as a regression (0.05)\n");
+    printf("Benchmarks: crypt, md5, md5-generic (md5.c's original block function), keys\n");
+    printf("(batched key derivation), keys-serial (one name at a time), keys-cached (names\n");
+    printf("already in the key cache), adler32, crc32, compress (deflate level 9, mostly\n");
+    printf("longest_match), decompress (mostly inflate_fast), pack, extract\n");
+}
+} // namespace
+
+std::vector<double> Throughputs(const BenchResult& result) {
+    std::vector<double> v;
+    for (double s : result.Seconds) {
+        double amount = result.Amount.Bytes > 0
+                            ? static_cast<double>(result.Amount.Bytes) / (1024.0 * 1024.0)
+                            : 1.0;
+        v.push_back(s > 0 ? amount / s : 0.0);
+    }
+    return v;
+}
+
+BenchInterval ConfidenceInterval(const std::vector<double>& samples) {
+    // two-sided 95% critical values of Student's t for 1 to 30 degrees of freedom
+    static const double T95[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    BenchInterval interval;
+    size_t n = samples.size();
+    if (n == 0) {
+        return interval;
+    }
+    for (double x : samples) {
+        interval.Mean += x;
+    }
+    interval.Mean /= static_cast<double>(n);
+    if (n < 2) {
+        return interval;
+    }
+    double variance = 0.0;
+    for (double x : samples) {
+        variance += (x - interval.Mean) * (x - interval.Mean);
+    }
+    variance /= static_cast<double>(n - 1);
+    double t = n - 1 <= std::size(T95) ? T95[n - 2] : 1.96;
+    interval.HalfWidth = t * std::sqrt(variance / static_cast<double>(n));
+    return interval;
+}
+
+int main(int argc, char** argv) {
+    SyntheticOptions synthetic;
+    BenchOptions bench;
+    ExtractOptions extractOptions;
+    PackOptions packOptions;
+    IoOptions io;
+    std::string saveBaseline;
+    std::string compareBaseline;
+    double threshold = 0.05;
+    Baseline current;
+    std::string profilePath;
+    bool filesGiven = false;
+    int argi = 1;
+    for (; argi < argc; ++argi) {
+        std::string_view arg(argv[argi]);
+        if (arg.substr(0, 2) != "--") {
+            break;
+        }
+        size_t eq = arg.find('=');
+        std::string_view key = arg.substr(0, eq);
+        std::string_view value = eq == std::string_view::npos ? "" : arg.substr(eq + 1);
+        std::string v(value);
+        uint64_t size = 0;
+        bool ok = true;
+        bool workload = true; // whether the option changes what is measured
+        if (key == "--files") {
+            synthetic.Files = strtoull(v.c_str(), nullptr, 10);
+            filesGiven = true;
+        } else if (key == "--profile") {
+            profilePath = v;
+        } else if (key == "--fanout") {
+            synthetic.FolderFanout = strtoull(v.c_str(), nullptr, 10);
+        } else if (key == "--sizes") {
+            ok = ParseSizes(value, synthetic);
+        } else if (key == "--compressibility") {
+            synthetic.Compressibility = atof(v.c_str());
+        } else if (key == "--stored-share") {
+            synthetic.StoredShare = atof(v.c_str());
+        } else if (key == "--seed") {
+            synthetic.Seed = strtoull(v.c_str(), nullptr, 10);
+        } else if (key == "--kernel-size") {
+            ok = ParseSize(value, size) && size > 0;
+            bench.KernelSize = static_cast<size_t>(size);
+        } else if (key == "--iterations") {
+            bench.Iterations = std::max<size_t>(1, strtoull(v.c_str(), nullptr, 10));
+            workload = false;
+        } else if (key == "--warmup") {
+            bench.Warmup = strtoull(v.c_str(), nullptr, 10);
+            workload = false;
+        } else if (key == "--save-baseline") {
+            saveBaseline = v;
+            workload = false;
+        } else if (key == "--compare") {
+            compareBaseline = v;
+            workload = false;
+        } else if (key == "--threshold") {
+            threshold = atof(v.c_str());
+            workload = false;
+        } else if (key == "--only") {
+            size_t start = 0;
+            while (start <= v.size()) {
+                size_t comma = std::min(v.find(',', start), v.size());
+                bench.Only.push_back(v.substr(start, comma - start));
+                start = comma + 1;
+            }
+            workload = false;
+        } else if (arg == "--io=sync") {
+            io.Async = false;
+        } else if (arg == "--io=threads") {
+            io.Async = true;
+            io.Backend = IoBackendKind::ThreadPool;
+        } else if (arg == "--io=uring") {
+            io.Async = true;
+            io.Backend = IoBackendKind::IoUring;
+        } else if (arg == "--order=table") {
+            extractOptions.Order = ExtractOrder::Table;
+        } else if (arg == "--order=offset") {
+            extractOptions.Order = ExtractOrder::DataOffset;
+        } else if (arg == "--help") {
+            PrintUsage();
+            return 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            printf("Invalid option: %s\n", argv[argi]);
+            return -1;
+        }
+        if (workload) {
+            current.Config += current.Config.empty() ? "" : " ";
+            current.Config += arg;
+        }
+    }
+    extractOptions.Io = io;
+    packOptions.Io = io;
+
+    std::filesystem::path work = std::filesystem::temp_directory_path() / "YggdraBench";
+    if (argi < argc) {
+        work = argv[argi];
+    }
+    std::filesystem::path tree = work / "tree";
+    std::filesystem::path archive = work / "tree.bin";
+    std::filesystem::path out = work / "out";
+
+    auto& results = current.Results;
+    try {
+        if (!profilePath.empty()) {
+            synthetic.Profile = LoadWorkloadProfile(profilePath);
+            if (!filesGiven) {
+                synthetic.Files = static_cast<size_t>(synthetic.Profile->Files);
+            }
+        }
+
+        std::mt19937_64 rng(synthetic.Seed);
+        auto plain = GenerateSyntheticData(bench.KernelSize, synthetic.Compressibility, rng);
+
+        if (Selected(bench, "crypt")) {
+            auto buffer = plain;
+            buffer.resize(buffer.size() & ~size_t(3));
+            results.push_back(RunBenchmark("crypt", bench, nullptr, [&] {
+                Crypt(buffer.data(), buffer.data(), buffer.size(), "bench.dat");
+                return BenchAmount{buffer.size(), 0};
+            }));
+        }
+        if (Selected(bench, "md5")) {
+            results.push_back(RunBenchmark("md5", bench, nullptr, [&] {
+                HashBuffer(plain, md5_init, md5_append, md5_finish);
+                return BenchAmount{plain.size(), 0};
+            }));
+        }
+        if (Selected(bench, "md5-generic")) {
+            results.push_back(RunBenchmark("md5-generic", bench, nullptr, [&] {
+                HashBuffer(plain, md5_generic_init, md5_generic_append, md5_generic_finish);
+                return BenchAmount{plain.size(), 0};
+            }));
+        }
+        if (Selected(bench, "keys") || Selected(bench, "keys-serial")
+            || Selected(bench, "keys-cached")) {
+            // short names like those in real archives, where key derivation costs the most
+            std::vector<std::string> names;
+            uint64_t nameBytes = 0;
+            for (size_t i = 0; i < 65536; ++i) {
+                char name[32];
+                snprintf(name, sizeof(name), "file%06zu.dat", i);
+                nameBytes += names.emplace_back(name).size();
+            }
+            std::vector<std::string_view> views(names.begin(), names.end());
+            // keys and keys-serial start from an empty key cache, keys-cached from a full one
+            if (Selected(bench, "keys")) {
+                results.push_back(RunBenchmark("keys", bench, ClearKeyCache, [&] {
+                    DeriveKeys(views);
+                    return BenchAmount{nameBytes, names.size()};
+                }));
+            }
+            if (Selected(bench, "keys-serial")) {
+                results.push_back(RunBenchmark("keys-serial", bench, ClearKeyCache, [&] {
+                    for (auto name : views) {
+                        DeriveKey(name);
+                    }
+                    return BenchAmount{nameBytes, names.size()};
+                }));
+            }
+            if (Selected(bench, "keys-cached")) {
+                DeriveKeys(views);
+                results.push_back(RunBenchmark("keys-cached", bench, nullptr, [&] {
+                    DeriveKeys(views);
+                    return BenchAmount{nameBytes, names.size()};
+                }));
+            }
+        }
+        if (Selected(bench, "adler32")) {
+            results.push_back(RunBenchmark("adler32", bench, nullptr, [&] {
+                adler32_z(adler32_z(0, nullptr, 0), (const Bytef*)plain.data(), plain.size());
+                return BenchAmount{plain.size(), 0};
+            }));
+        }
+        if (Selected(bench, "crc32")) {
+            results.push_back(RunBenchmark("crc32", bench, nullptr, [&] {
+                crc32_z(crc32_z(0, nullptr, 0), (const Bytef*)plain.data(), plain.size());
+                return BenchAmount{plain.size(), 0};
+            }));
+        }
+
+        std::vector<char> compressed;
+        if (Selected(bench, "compress") || Selected(bench, "decompress")) {
+            compressed = Compress(plain, "bench.dat");
+        }
+        if (Selected(bench, "compress")) {
+            results.push_back(RunBenchmark("compress", bench, nullptr, [&] {
+                Compress(plain, "bench.dat");
+                return BenchAmount{plain.size(), 0};
+            }));
+        }
+        if (Selected(bench, "decompress")) {
+            results.push_back(RunBenchmark("decompress", bench, nullptr, [&] {
+                Decompress(compressed, "bench.dat");
+                return BenchAmount{plain.size(), 0};
+            }));
+        }
+
+        bool pack = Selected(bench, "pack");
+        bool extract = Selected(bench, "extract");
+        if (pack || extract) {
+            printf("Generating %zu files in %s\n", synthetic.Files, tree.string().c_str());
+            std::filesystem::remove_all(tree);
+            uint64_t treeBytes = GenerateSyntheticTree(tree, synthetic);
+            BenchAmount amount{treeBytes, synthetic.Files};
+
+            // extraction needs the archive even when pack isn't timed
+            const auto packTree = [&] {
+                if (PackArchive(tree.string(), archive.string(), packOptions) != 0) {
+                    throw "failed to pack the synthetic tree";
+                }
+                return amount;
+            };
+            if (pack) {
+                results.push_back(RunBenchmark("pack", bench, nullptr, packTree));
+            } else {
+                packTree();
+            }
+
+            if (extract) {
+                results.push_back(RunBenchmark(
+                    "extract", bench, [&] { std::filesystem::remove_all(out); },
+                    [&] {
+                        auto f = OpenFile(archive, FileMode::Read, io.Files);
+                        if (!f || ExtractArchive(*f, out.string(), extractOptions) != 0) {
+                            throw "failed to extract the synthetic archive";
+                        }
+                        return amount;
+                    }));
+            }
+        }
+    } catch (const char* e) {
+        printf("Error: %s\n", e);
+        return -1;
+    }
+
+    PrintResults(results);
+
+    try {
+        if (!saveBaseline.empty()) {
+            SaveBaseline(saveBaseline, current);
+        }
+        if (!compareBaseline.empty()) {
+            printf("\n");
+            Baseline baseline = LoadBaseline(compareBaseline);
+            size_t regressions = CompareWithBaseline(stdout, baseline, current, threshold);
+            if (regressions > 0) {
+                printf("%zu benchmark(s) regressed by more than %.1f%%\n", regressions,
+                       threshold * 100.0);
+                return 1;
+            }
+        }
+    } catch (const char* e) {
+        printf("Error: %s\n", e);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct BenchAmount {
+    uint64_t Bytes = 0;
+    uint64_t Files = 0;
+};
+
+struct BenchResult {
+    std::string Name;
+    std::vector<double> Seconds; // one per measured iteration
+    BenchAmount Amount;          // processed by each iteration
+};
+
+// A mean and the half width of its 95% confidence interval.
+struct BenchInterval {
+    double Mean = 0.0;
+    double HalfWidth = 0.0;
+};
+
+// MB/s of each run, or runs per second for benchmarks that don't process bytes.
+std::vector<double> Throughputs(const BenchResult& result);
+
+// Student's t interval, so that a handful of runs gives an honest width.
+BenchInterval ConfidenceInterval(const std::vector<double>& samples);
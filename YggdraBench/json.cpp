@@ -0,0 +1,195 @@
+#include "json.h"
+
+#include <cstdlib>
+
+#include "fileio.h"
+
+namespace {
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : Text(text) {}
+
+    JsonValue ParseDocument() {
+        JsonValue v = ParseValue();
+        SkipWhitespace();
+        if (Pos != Text.size()) {
+            throw "unexpected data after JSON value";
+        }
+        return v;
+    }
+
+private:
+    void SkipWhitespace() {
+        while (Pos < Text.size()
+               && (Text[Pos] == ' ' || Text[Pos] == '\t' || Text[Pos] == '\n'
+                   || Text[Pos] == '\r')) {
+            ++Pos;
+        }
+    }
+
+    bool Consume(char c) {
+        SkipWhitespace();
+        if (Pos < Text.size() && Text[Pos] == c) {
+            ++Pos;
+            return true;
+        }
+        return false;
+    }
+
+    void Expect(char c) {
+        if (!Consume(c)) {
+            throw "malformed JSON";
+        }
+    }
+
+    bool ConsumeWord(std::string_view word) {
+        if (Text.substr(Pos, word.size()) == word) {
+            Pos += word.size();
+            return true;
+        }
+        return false;
+    }
+
+    JsonValue ParseValue() {
+        SkipWhitespace();
+        if (Pos >= Text.size()) {
+            throw "unexpected end of JSON";
+        }
+        JsonValue v;
+        char c = Text[Pos];
+        if (c == '{') {
+            ++Pos;
+            v.Kind = JsonValue::Type::Object;
+            if (Consume('}')) {
+                return v;
+            }
+            do {
+                SkipWhitespace();
+                std::string key = ParseString();
+                Expect(':');
+                v.Object.emplace_back(std::move(key), ParseValue());
+            } while (Consume(','));
+            Expect('}');
+        } else if (c == '[') {
+            ++Pos;
+            v.Kind = JsonValue::Type::Array;
+            if (Consume(']')) {
+                return v;
+            }
+            do {
+                v.Array.push_back(ParseValue());
+            } while (Consume(','));
+            Expect(']');
+        } else if (c == '"') {
+            v.Kind = JsonValue::Type::String;
+            v.String = ParseString();
+        } else if (ConsumeWord("true")) {
+            v.Kind = JsonValue::Type::Bool;
+            v.Bool = true;
+        } else if (ConsumeWord("false")) {
+            v.Kind = JsonValue::Type::Bool;
+        } else if (ConsumeWord("null")) {
+        } else {
+            std::string number(Text.substr(Pos, 64));
+            char* end = nullptr;
+            v.Kind = JsonValue::Type::Number;
+            v.Number = strtod(number.c_str(), &end);
+            if (end == number.c_str()) {
+                throw "malformed JSON";
+            }
+            Pos += static_cast<size_t>(end - number.c_str());
+        }
+        return v;
+    }
+
+    std::string ParseString() {
+        if (Pos >= Text.size() || Text[Pos] != '"') {
+            throw "malformed JSON";
+        }
+        ++Pos;
+        std::string s;
+        while (Pos < Text.size() && Text[Pos] != '"') {
+            char c = Text[Pos++];
+            if (c != '\\') {
+                s.push_back(c);
+                continue;
+            }
+            if (Pos >= Text.size()) {
+                break;
+            }
+            char e = Text[Pos++];
+            if (e == 'u') {
+                // only what WriteJsonString produces: control characters
+                std::string hex(Text.substr(Pos, 4));
+                s.push_back(static_cast<char>(strtoul(hex.c_str(), nullptr, 16)));
+                Pos += 4;
+            } else if (e == 'n') {
+                s.push_back('\n');
+            } else if (e == 't') {
+                s.push_back('\t');
+            } else if (e == 'r') {
+                s.push_back('\r');
+            } else {
+                s.push_back(e);
+            }
+        }
+        if (Pos >= Text.size()) {
+            throw "unterminated JSON string";
+        }
+        ++Pos;
+        return s;
+    }
+
+    std::string_view Text;
+    size_t Pos = 0;
+};
+} // namespace
+
+const JsonValue* JsonValue::Find(std::string_view key) const {
+    for (const auto& member : Object) {
+        if (member.first == key) {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+double JsonValue::NumberOr(std::string_view key, double fallback) const {
+    const JsonValue* v = Find(key);
+    return v && v->Kind == Type::Number ? v->Number : fallback;
+}
+
+std::string JsonValue::StringOr(std::string_view key, std::string_view fallback) const {
+    const JsonValue* v = Find(key);
+    return std::string(v && v->Kind == Type::String ? std::string_view(v->String) : fallback);
+}
+
+JsonValue ParseJson(std::string_view text) {
+    return JsonParser(text).ParseDocument();
+}
+
+JsonValue ReadJsonFile(const std::string& path) {
+    auto f = OpenFile(std::filesystem::path(path), FileMode::Read, FileBackend::Positional);
+    if (!f) {
+        throw "failed to open JSON file";
+    }
+    std::string text;
+    text.resize(static_cast<size_t>(f->Size()));
+    text.resize(f->ReadAt(text.data(), text.size(), 0));
+    return ParseJson(text);
+}
+
+void WriteJsonString(FILE* out, std::string_view s) {
+    fputc('"', out);
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            fprintf(out, "\\u%04x", static_cast<unsigned>(c));
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
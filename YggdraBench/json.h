@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Just enough JSON for the files the benchmark writes and reads back: baselines and workload
+// profiles. Malformed input is thrown as a string.
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type Kind = Type::Null;
+    bool Bool = false;
+    double Number = 0.0;
+    std::string String;
+    std::vector<JsonValue> Array;
+    std::vector<std::pair<std::string, JsonValue>> Object; // in file order
+
+    // The member with the given key, or nullptr if there's none or this isn't an object.
+    const JsonValue* Find(std::string_view key) const;
+
+    double NumberOr(std::string_view key, double fallback) const;
+    std::string StringOr(std::string_view key, std::string_view fallback) const;
+};
+
+JsonValue ParseJson(std::string_view text);
+
+// Reads and parses a whole file; throws if it can't be read.
+JsonValue ReadJsonFile(const std::string& path);
+
+// Writes s as a quoted JSON string.
+void WriteJsonString(FILE* out, std::string_view s);
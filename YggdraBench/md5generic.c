@@ -0,0 +1,9 @@
+/* md5.c with its original md5_process, renamed so it links next to the real one. */
+#define MD5_GENERIC
+#define md5_init md5_generic_init
+#define md5_append md5_generic_append
+#define md5_finish md5_generic_finish
+#define md5_many md5_generic_many
+#define md5_many_lanes md5_generic_many_lanes
+
+#include "md5.c"
@@ -0,0 +1,271 @@
+#include "synthetic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "fileio.h"
+#include "json.h"
+
+namespace {
+const char* const Words[] = {
+    "texture", "sprite",  "dialog", "scene",  "battle", "unit",   "sound",  "effect",
+    "layer",   "anchor",  "frame",  "index",  "value",  "script", "event",  "flag",
+    "{",       "}",       "=",      ";",      "\n",     "  ",     "0",      "1",
+};
+
+// Chunks are small enough that the share of text comes out close to the requested one even for
+// small files.
+constexpr size_t ChunkSize = 256;
+
+uint64_t DrawSize(const SyntheticOptions& options, std::mt19937_64& rng) {
+    uint64_t size = options.MedianSize;
+    switch (options.Sizes) {
+    case SizeDistribution::Fixed:
+        break;
+    case SizeDistribution::Uniform:
+        size = std::uniform_int_distribution<uint64_t>(options.MinSize, options.MaxSize)(rng);
+        break;
+    case SizeDistribution::LogNormal: {
+        double median = static_cast<double>(std::max<uint64_t>(1, options.MedianSize));
+        std::lognormal_distribution<double> d(std::log(median), 1.5);
+        size = static_cast<uint64_t>(d(rng));
+        break;
+    }
+    }
+    return std::clamp(size, options.MinSize, options.MaxSize);
+}
+
+// level 9 deflate ratio of the text chunks GenerateSyntheticData writes; random chunks don't
+// compress at all
+constexpr double TextRatio = 0.22;
+
+std::discrete_distribution<size_t> HistogramDistribution(const std::vector<uint64_t>& histogram) {
+    if (std::all_of(histogram.begin(), histogram.end(), [](uint64_t n) { return n == 0; })) {
+        return std::discrete_distribution<size_t>{1.0}; // always 0
+    }
+    return std::discrete_distribution<size_t>(histogram.begin(), histogram.end());
+}
+
+// a value from a bit length bucket, see ProfileSizeBucket
+uint64_t DrawFromBucket(size_t bucket, std::mt19937_64& rng) {
+    if (bucket == 0) {
+        return 0;
+    }
+    uint64_t low = uint64_t(1) << (bucket - 1);
+    return std::uniform_int_distribution<uint64_t>(low, low * 2 - 1)(rng);
+}
+
+void WriteSyntheticFile(const std::filesystem::path& path, const std::vector<char>& data) {
+    auto f = OpenFile(path, FileMode::Write, FileBackend::Positional);
+    if (!f) {
+        throw "failed to create synthetic file";
+    }
+    f->WriteAt(data.data(), data.size(), 0);
+}
+
+// Names are unique through the id and padded up to the length drawn from the profile.
+std::string ProfileName(char kind, size_t id, size_t length, const char* extension) {
+    char digits[32];
+    snprintf(digits, sizeof(digits), "%c%zx", kind, id);
+    std::string name = digits;
+    size_t used = name.size() + strlen(extension);
+    if (length > used) {
+        name.append(length - used, 'n');
+    }
+    return name + extension;
+}
+
+// Builds the folders as files ask for them: a file at depth d goes into the open folder at that
+// depth, and once that folder has as many children as drawn from the fanout histogram, a new one
+// is opened next to it.
+class ProfileTree {
+public:
+    ProfileTree(const std::filesystem::path& root, const WorkloadProfile& profile,
+                std::mt19937_64& rng)
+      : Root(root), Rng(rng), Fanout(HistogramDistribution(profile.Fanout)),
+        NameLengths(HistogramDistribution(profile.NameLengths)) {}
+
+    // The folder for a new entry at the given depth, counting the entry against it.
+    std::filesystem::path Place(size_t depth) {
+        if (depth == 0) {
+            return Root;
+        }
+        if (Open.size() < depth) {
+            Open.resize(depth);
+        }
+        // deeper levels never resize Open, so the reference stays valid across the recursion
+        auto& folder = Open[depth - 1];
+        if (folder.Path.empty() || folder.Children >= folder.Capacity) {
+            std::filesystem::path parent = Place(depth - 1);
+            folder.Path = parent / ProfileName('d', NextId++, NameLength(), "");
+            folder.Children = 0;
+            folder.Capacity = std::max<uint64_t>(1, DrawFromBucket(Fanout(Rng), Rng));
+            std::filesystem::create_directories(folder.Path);
+        }
+        ++folder.Children;
+        return folder.Path;
+    }
+
+    std::string FileName(const char* extension) {
+        return ProfileName('f', NextId++, NameLength(), extension);
+    }
+
+private:
+    struct OpenFolder {
+        std::filesystem::path Path;
+        uint64_t Children = 0;
+        uint64_t Capacity = 0;
+    };
+
+    size_t NameLength() {
+        return NameLengths(Rng);
+    }
+
+    std::filesystem::path Root;
+    std::mt19937_64& Rng;
+    std::discrete_distribution<size_t> Fanout;
+    std::discrete_distribution<size_t> NameLengths;
+    std::vector<OpenFolder> Open; // by depth - 1
+    size_t NextId = 0;
+};
+
+uint64_t GenerateProfiledTree(const std::filesystem::path& root, const SyntheticOptions& options) {
+    const WorkloadProfile& profile = *options.Profile;
+    std::mt19937_64 rng(options.Seed);
+    std::uniform_real_distribution<double> share(0.0, 1.0);
+
+    std::vector<uint64_t> bucketFiles;
+    for (const auto& b : profile.Sizes) {
+        bucketFiles.push_back(b.Files);
+    }
+    auto sizes = HistogramDistribution(bucketFiles);
+    auto depths = HistogramDistribution(profile.Depths);
+    ProfileTree tree(root, profile, rng);
+    std::filesystem::create_directories(root);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < options.Files; ++i) {
+        size_t bucket = sizes(rng);
+        ProfileSizeBucket b = bucket < profile.Sizes.size() ? profile.Sizes[bucket]
+                                                            : ProfileSizeBucket{};
+        bool compressed = b.Files > 0 && share(rng) * b.Files < b.Compressed;
+
+        // files stored uncompressed are named .png so the packer leaves them alone; compressed
+        // ones get the share of text that brings them to the profile's ratio
+        double compressibility = 0.0;
+        if (compressed && b.CompressedOriginalBytes > 0) {
+            double ratio = static_cast<double>(b.CompressedBytes) / b.CompressedOriginalBytes;
+            compressibility = std::clamp((1.0 - ratio) / (1.0 - TextRatio), 0.0, 1.0);
+        }
+
+        std::filesystem::path folder = tree.Place(depths(rng));
+        std::string name = tree.FileName(compressed ? ".dat" : ".png");
+        auto data = GenerateSyntheticData(static_cast<size_t>(DrawFromBucket(bucket, rng)),
+                                          compressibility, rng);
+        WriteSyntheticFile(folder / name, data);
+        total += data.size();
+    }
+    return total;
+}
+} // namespace
+
+WorkloadProfile LoadWorkloadProfile(const std::string& path) {
+    JsonValue root = ReadJsonFile(path);
+    WorkloadProfile profile;
+    profile.Files = static_cast<uint64_t>(root.NumberOr("files", 0));
+    profile.Folders = static_cast<uint64_t>(root.NumberOr("folders", 0));
+    if (const JsonValue* sizes = root.Find("sizes")) {
+        for (const auto& s : sizes->Array) {
+            ProfileSizeBucket b;
+            b.Files = static_cast<uint64_t>(s.NumberOr("files", 0));
+            b.OriginalBytes = static_cast<uint64_t>(s.NumberOr("original_bytes", 0));
+            b.Compressed = static_cast<uint64_t>(s.NumberOr("compressed", 0));
+            b.CompressedBytes = static_cast<uint64_t>(s.NumberOr("compressed_bytes", 0));
+            b.CompressedOriginalBytes =
+                static_cast<uint64_t>(s.NumberOr("compressed_original_bytes", 0));
+            profile.Sizes.push_back(b);
+        }
+    }
+    const auto histogram = [&root](const char* name, std::vector<uint64_t>& out) {
+        if (const JsonValue* h = root.Find(name)) {
+            for (const auto& n : h->Array) {
+                out.push_back(static_cast<uint64_t>(n.Number));
+            }
+        }
+    };
+    histogram("fanout", profile.Fanout);
+    histogram("depths", profile.Depths);
+    histogram("name_lengths", profile.NameLengths);
+    if (profile.Files == 0 || profile.Sizes.empty()) {
+        throw "workload profile has no files";
+    }
+    return profile;
+}
+
+std::vector<char> GenerateSyntheticData(size_t size, double compressibility, std::mt19937_64& rng) {
+    std::vector<char> data;
+    data.reserve(size);
+    std::uniform_real_distribution<double> share(0.0, 1.0);
+    std::uniform_int_distribution<size_t> word(0, std::size(Words) - 1);
+    while (data.size() < size) {
+        size_t chunk = std::min(ChunkSize, size - data.size());
+        if (share(rng) < compressibility) {
+            size_t end = data.size() + chunk;
+            while (data.size() < end) {
+                const char* w = Words[word(rng)];
+                for (; *w && data.size() < end; ++w) {
+                    data.push_back(*w);
+                }
+            }
+        } else {
+            for (size_t i = 0; i < chunk; ++i) {
+                data.push_back(static_cast<char>(rng() & 0xff));
+            }
+        }
+    }
+    return data;
+}
+
+uint64_t GenerateSyntheticTree(const std::filesystem::path& root, const SyntheticOptions& options) {
+    if (options.Profile) {
+        return GenerateProfiledTree(root, options);
+    }
+
+    std::mt19937_64 rng(options.Seed);
+    std::uniform_real_distribution<double> share(0.0, 1.0);
+    size_t fanout = std::max<size_t>(2, options.FolderFanout);
+
+    // folder levels needed so that no folder holds more than fanout entries
+    size_t levels = 0;
+    for (size_t capacity = fanout; capacity < options.Files; capacity *= fanout) {
+        ++levels;
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < options.Files; ++i) {
+        std::filesystem::path folder = root;
+        size_t divisor = 1;
+        for (size_t level = 0; level < levels; ++level) {
+            divisor *= fanout;
+        }
+        for (size_t level = 0; level < levels; ++level) {
+            char name[32];
+            snprintf(name, sizeof(name), "dir%03zu", (i / divisor) % fanout);
+            folder /= name;
+            divisor /= fanout;
+        }
+        std::filesystem::create_directories(folder);
+
+        char name[32];
+        snprintf(name, sizeof(name), "file%06zu.%s", i,
+                 share(rng) < options.StoredShare ? "png" : "dat");
+        auto data = GenerateSyntheticData(static_cast<size_t>(DrawSize(options, rng)),
+                                          options.Compressibility, rng);
+        WriteSyntheticFile(folder / name, data);
+        total += data.size();
+    }
+    return total;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "profile.h"
+
+enum class SizeDistribution {
+    Fixed,     // every file is MedianSize
+    Uniform,   // evenly spread between MinSize and MaxSize
+    LogNormal, // most files around MedianSize with a long tail up to MaxSize, like real assets
+};
+
+// Describes a folder tree to generate. The same options and seed always give the same tree.
+struct SyntheticOptions {
+    size_t Files = 1000;
+
+    // entries per folder; files are spread over as many levels as that needs
+    size_t FolderFanout = 32;
+
+    SizeDistribution Sizes = SizeDistribution::LogNormal;
+    uint64_t MinSize = 0;
+    uint64_t MedianSize = 16 * 1024;
+    uint64_t MaxSize = 4 * 1024 * 1024;
+
+    // 0 gives random bytes that don't compress, 1 gives repetitive text
+    double Compressibility = 0.5;
+
+    // share of files named .png, which are stored without compression when packed
+    double StoredShare = 0.1;
+
+    uint64_t Seed = 1;
+
+    // When set, sizes, compression, nesting, fanout and name lengths are drawn from the profile
+    // instead, and only Files and Seed of the options above apply.
+    std::optional<WorkloadProfile> Profile;
+};
+
+// Reads a profile written by YggdraDecode --profile.
+WorkloadProfile LoadWorkloadProfile(const std::string& path);
+
+// File contents of the given size where roughly a compressibility share of the bytes is
+// repetitive text and the rest random.
+std::vector<char> GenerateSyntheticData(size_t size, double compressibility, std::mt19937_64& rng);
+
+// Writes the tree below root, which is created if needed. Returns the total file size.
+uint64_t GenerateSyntheticTree(const std::filesystem::path& root, const SyntheticOptions& options);
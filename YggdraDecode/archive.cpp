@@ -0,0 +1,1113 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "archive.h"
+#include "fileio.h"
+#include "inflateindex.h"
+#include "iobackend.h"
+#include "md5.h"
+#include "memstats.h"
+#include "stats.h"
+#include "zlib.h"
+
+bool case_insensitive_equals(char lhs, char rhs) {
+    const char c0 = (lhs >= 'a' && lhs <= 'z') ? (lhs - ('a' + 'A')) : lhs;
+    const char c1 = (rhs >= 'a' && rhs <= 'z') ? (rhs - ('a' + 'A')) : rhs;
+    return c0 == c1;
+}
+
+bool ends_with_case_insensitive(std::string_view string, std::string_view ending) {
+    if (string.size() < ending.size()) {
+        return true;
+    }
+    for (size_t i = 0; i < ending.size(); ++i) {
+        const char cs = string[string.size() - ending.size() + i];
+        const char ce = ending[i];
+        if (!case_insensitive_equals(cs, ce)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Crypt(char* dst, const char* src, size_t length, const CryptKey& key,
+           std::string_view filename) {
+    if ((length % 4) != 0) {
+        throw "length must be divisible by 4";
+    }
+
+    PhaseTimer timer(StatPhase::Crypt, length, filename);
+    for (size_t i = 0; i < length; i += 4) {
+        uint32_t tmp;
+        std::memcpy(&tmp, src + i, 4);
+        tmp ^= key[(i / 4) % 4];
+        std::memcpy(dst + i, &tmp, 4);
+    }
+}
+
+void Crypt(char* dst, char* src, size_t length, std::string_view filename) {
+    Crypt(dst, src, length, DeriveKey(filename), filename);
+}
+
+void CryptAt(char* dst, const char* src, size_t length, const CryptKey& key, uint64_t phase,
+             std::string_view filename) {
+    PhaseTimer timer(StatPhase::Crypt, length, filename);
+    std::array<char, 16> keyBytes;
+    std::memcpy(keyBytes.data(), key.data(), keyBytes.size());
+    std::array<char, 16> turned;
+    for (size_t j = 0; j < turned.size(); ++j) {
+        turned[j] = keyBytes[(phase + j) % 16];
+    }
+    uint64_t words[2];
+    std::memcpy(words, turned.data(), sizeof(words));
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint64_t tmp[2];
+        std::memcpy(tmp, src + i, 16);
+        tmp[0] ^= words[0];
+        tmp[1] ^= words[1];
+        std::memcpy(dst + i, tmp, 16);
+    }
+    for (; i < length; ++i) {
+        dst[i] = src[i] ^ turned[i % 16];
+    }
+}
+
+std::vector<char> ReadDecrypted(File& f, uint64_t offset, size_t length, const CryptKey& key,
+                                std::string_view filename) {
+    std::vector<char> in_data;
+    in_data.resize(length);
+    {
+        PhaseTimer timer(StatPhase::Read, length, filename);
+        f.ReadAt(in_data.data(), in_data.size(), offset);
+    }
+
+    std::vector<char> out_data;
+    out_data.resize(in_data.size());
+
+    Crypt(out_data.data(), in_data.data(), in_data.size(), key, filename);
+
+    return out_data;
+}
+
+std::vector<char> Encrypt(const std::vector<char>& in_data, const CryptKey& key,
+                          std::string_view filename) {
+    std::vector<char> input = in_data;
+    while ((input.size() % 4) != 0) {
+        input.push_back(0);
+    }
+    std::vector<char> output;
+    output.resize(input.size());
+
+    Crypt(output.data(), input.data(), input.size(), key, filename);
+
+    return output;
+}
+
+std::vector<char> Encrypt(const std::vector<char>& in_data, std::string_view filename) {
+    return Encrypt(in_data, DeriveKey(filename), filename);
+}
+
+std::vector<char> Decompress(const std::vector<char>& out_data, std::string_view filename) {
+    std::vector<char> decomp_data;
+    uint32_t decompSize;
+    std::memcpy(&decompSize, out_data.data(), 4);
+    decomp_data.resize(decompSize);
+    PhaseTimer timer(StatPhase::Decompress, decompSize, filename);
+
+    z_stream zs{};
+    zs.zalloc = ZlibAlloc;
+    zs.zfree = ZlibFree;
+    inflateInit(&zs);
+
+    zs.avail_in = out_data.size() - 4;
+    zs.next_in = (Bytef*)out_data.data() + 4;
+    zs.avail_out = decomp_data.size();
+    zs.next_out = (Bytef*)decomp_data.data();
+    inflate(&zs, Z_FINISH);
+
+    inflateEnd(&zs);
+
+    return decomp_data;
+}
+
+std::vector<char> DecompressChecked(const char* data, size_t size, std::string_view filename) {
+    if (size < 4) {
+        throw "compressed blob shorter than its size prefix";
+    }
+    uint32_t decompSize;
+    std::memcpy(&decompSize, data, 4);
+    // deflate can't do better than 1032:1, so a bigger size is a damaged prefix; don't allocate it
+    if (decompSize > uint64_t(size - 4) * 1032) {
+        throw "size prefix is larger than the stream can inflate to";
+    }
+    std::vector<char> decomp_data(decompSize);
+    PhaseTimer timer(StatPhase::Decompress, decompSize, filename);
+
+    z_stream zs{};
+    zs.zalloc = ZlibAlloc;
+    zs.zfree = ZlibFree;
+    if (inflateInit(&zs) != Z_OK) {
+        throw "failed to initialize inflate";
+    }
+
+    // zlib rejects a null output buffer even when there's nothing to write
+    char empty;
+    zs.avail_in = static_cast<uInt>(size - 4);
+    zs.next_in = (Bytef*)data + 4;
+    zs.avail_out = decompSize;
+    zs.next_out = (Bytef*)(decompSize > 0 ? decomp_data.data() : &empty);
+    int rv = inflate(&zs, Z_FINISH);
+    const char* msg = zs.msg; // zlib's messages are string literals
+    uInt avail_out = zs.avail_out;
+    inflateEnd(&zs);
+
+    // the stream only ends after its Adler-32 has been checked
+    if (rv == Z_STREAM_END) {
+        if (avail_out != 0) {
+            throw "inflates to less than its stored size";
+        }
+        return decomp_data;
+    }
+    if (rv == Z_BUF_ERROR && avail_out == 0) {
+        throw "inflates to more than its stored size";
+    }
+    if (rv == Z_BUF_ERROR) {
+        throw "truncated zlib stream";
+    }
+    throw msg ? msg : "damaged zlib stream";
+}
+
+std::vector<char> Compress(const std::vector<char>& in_data, std::string_view filename) {
+    std::vector<char> comp_data;
+    uint32_t decompSize = static_cast<uint32_t>(in_data.size());
+    if (in_data.size() != static_cast<size_t>(decompSize)) {
+        throw "data too long to compress";
+    }
+    PhaseTimer timer(StatPhase::Compress, decompSize, filename);
+
+    z_stream zs{};
+    zs.zalloc = ZlibAlloc;
+    zs.zfree = ZlibFree;
+    deflateInit(&zs, 9);
+
+    auto bound = deflateBound(&zs, decompSize);
+    comp_data.resize(static_cast<size_t>(bound) + 4);
+    std::memcpy(comp_data.data(), &decompSize, 4);
+
+    zs.avail_in = decompSize;
+    zs.next_in = (Bytef*)in_data.data();
+    zs.avail_out = bound;
+    zs.next_out = (Bytef*)comp_data.data() + 4;
+    deflate(&zs, Z_FINISH);
+    auto avail_out = zs.avail_out;
+    deflateEnd(&zs);
+
+    comp_data.resize((static_cast<size_t>(bound) - avail_out) + 4);
+
+
+    return comp_data;
+}
+
+struct ExtractJob {
+    size_t Index;
+    std::string OutPath;
+};
+
+void CollectExtractJobs(std::vector<ExtractJob>& jobs, std::string outfolder,
+                        std::vector<FileTableEntry>& fileTable, size_t idx) {
+    if (idx >= fileTable.size()) {
+        return;
+    }
+    auto& e = fileTable[idx];
+    if (e.Extracted) {
+        return;
+    }
+    e.Extracted = true;
+
+    {
+        PhaseTimer timer(StatPhase::CreateDirectories);
+        std::filesystem::create_directories(std::filesystem::path(outfolder));
+    }
+
+    size_t size = e.Length & 0x3fff'ffff;
+    bool isFolder = !!(e.Length & 0x8000'0000);
+    std::string outpath = outfolder + "/" + e.Name;
+
+    if (isFolder) {
+        // printf("Extracting folder: Length: %zu, Name: %s\n", size, e.Name.c_str());
+        size_t folder_offset = e.DataOffset / 12;
+        for (size_t i = 0; i < size; ++i) {
+            CollectExtractJobs(jobs, outpath, fileTable, folder_offset + i);
+        }
+    } else {
+        jobs.emplace_back(ExtractJob{idx, std::move(outpath)});
+    }
+}
+
+size_t GetStoredSize(const FileTableEntry& e) {
+    size_t size = e.Length & 0x3fff'ffff;
+    size_t extra_bytes = size & 3;
+    return extra_bytes ? (size + 4 - extra_bytes) : size;
+}
+
+// Turns a decrypted blob into the file contents and returns how many bytes of it to write.
+size_t DecodeExtractedFile(const FileTableEntry& e, std::vector<char>& data) {
+    // printf("Extracting file: Length: %zu, Name: %s, Compressed: %s\n", size, e.Name.c_str(),
+    //        isCompressed ? "yes" : "no");
+    size_t size = e.Length & 0x3fff'ffff;
+    bool isCompressed = !!(e.Length & 0x4000'0000);
+    size_t extra_bytes = size & 3;
+    if (isCompressed) {
+        extra_bytes = 0;
+        data = Decompress(data, e.Name);
+    }
+    return data.size() - (extra_bytes ? (4 - extra_bytes) : 0);
+}
+
+void RemoveExistingOutput(const std::string& outpath, const ExtractOptions& options) {
+    if (options.UnlinkExisting) {
+        std::error_code ec;
+        std::filesystem::remove(std::filesystem::path(outpath), ec);
+    }
+}
+
+// Whether outpath already holds exactly these bytes. Sizes are compared first; files of the same
+// size are read back in chunks, or compared in place when they are mapped.
+bool OutputUnchanged(const std::string& outpath, const char* data, size_t length,
+                     std::string_view name, const ExtractOptions& options) {
+    auto f = OpenFile(std::filesystem::path(outpath), FileMode::Read, options.Io.Files);
+    if (!f || f->Size() != length) {
+        return false;
+    }
+    PhaseTimer timer(StatPhase::Read, length, name);
+    if (const char* mapped = f->MappedData()) {
+        return std::memcmp(mapped, data, length) == 0;
+    }
+    std::vector<char> buffer(std::min<size_t>(length, 1024 * 1024));
+    for (size_t offset = 0; offset < length; offset += buffer.size()) {
+        size_t chunk = std::min(buffer.size(), length - offset);
+        if (f->ReadAt(buffer.data(), chunk, offset) != chunk
+            || std::memcmp(buffer.data(), data + offset, chunk) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The whole file goes out in a single positioned write straight from the decoded buffer.
+void WriteExtractedFile(const FileTableEntry& e, const std::string& outpath,
+                        std::vector<char> data, const ExtractOptions& options,
+                        Manifest* manifest) {
+    size_t length = DecodeExtractedFile(e, data);
+    if (manifest) {
+        manifest->Add(outpath, data.data(), length);
+    }
+    if (options.SkipUnchanged && OutputUnchanged(outpath, data.data(), length, e.Name, options)) {
+        return;
+    }
+    PhaseTimer timer(StatPhase::Write, length, e.Name);
+    RemoveExistingOutput(outpath, options);
+    auto f2 = OpenFile(std::filesystem::path(outpath), FileMode::Write, options.Io.Files);
+    if (!f2) {
+        throw "failed to open output file";
+    }
+    if (options.Preallocate && length > 0) {
+        f2->Preallocate(length);
+    }
+    f2->WriteAt(data.data(), length, 0);
+}
+
+void ExtractInTableOrder(File& f, const std::vector<FileTableEntry>& fileTable,
+                         const std::vector<ExtractJob>& jobs, uint64_t data_offset,
+                         const ExtractOptions& options, Manifest* manifest) {
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    for (const auto& job : jobs) {
+        const auto& e = fileTable[job.Index];
+        MemoryEntryScope entry(e.Name);
+        auto data =
+            ReadDecrypted(f, data_offset + e.DataOffset, GetStoredSize(e), e.Key, e.Name);
+        WriteExtractedFile(e, job.OutPath, std::move(data), options, manifest);
+    }
+}
+
+void SortJobsByDataOffset(std::vector<ExtractJob>& jobs,
+                          const std::vector<FileTableEntry>& fileTable) {
+    std::stable_sort(jobs.begin(), jobs.end(), [&](const ExtractJob& lhs, const ExtractJob& rhs) {
+        return fileTable[lhs.Index].DataOffset < fileTable[rhs.Index].DataOffset;
+    });
+}
+
+void ExtractInDataOrder(File& f, const std::vector<FileTableEntry>& fileTable,
+                        std::vector<ExtractJob>& jobs, uint64_t data_offset,
+                        const ExtractOptions& options, Manifest* manifest) {
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    SortJobsByDataOffset(jobs, fileTable);
+
+    std::vector<char> run;
+    size_t i = 0;
+    while (i < jobs.size()) {
+        // grow the run over every following blob that starts close enough behind it; blobs that
+        // overlap the run always join it, so runs never have to go back in the file
+        uint64_t runStart = fileTable[jobs[i].Index].DataOffset;
+        uint64_t runEnd = runStart + GetStoredSize(fileTable[jobs[i].Index]);
+        size_t j = i + 1;
+        while (j < jobs.size()) {
+            const auto& e = fileTable[jobs[j].Index];
+            uint64_t start = e.DataOffset;
+            uint64_t end = std::max(runEnd, start + GetStoredSize(e));
+            if (start >= runEnd
+                && (start - runEnd > options.CoalesceGap || end - runStart > options.CoalesceLimit)) {
+                break;
+            }
+            runEnd = end;
+            ++j;
+        }
+
+        run.resize(static_cast<size_t>(runEnd - runStart));
+        {
+            // a run serves several entries; it's named after the first
+            PhaseTimer timer(StatPhase::Read, run.size(), fileTable[jobs[i].Index].Name);
+            if (f.ReadAt(run.data(), run.size(), data_offset + runStart) != run.size()
+                && !f.IsSeekable()) {
+                throw "unexpected end of archive stream";
+            }
+        }
+
+        for (; i < j; ++i) {
+            const auto& e = fileTable[jobs[i].Index];
+            MemoryEntryScope entry(e.Name);
+            std::vector<char> data;
+            data.resize(GetStoredSize(e));
+            Crypt(data.data(), run.data() + (e.DataOffset - runStart), data.size(), e.Key,
+                  e.Name);
+            WriteExtractedFile(e, jobs[i].OutPath, std::move(data), options, manifest);
+        }
+    }
+}
+
+void ExtractWithBackend(File& f, const std::vector<FileTableEntry>& fileTable,
+                        const std::vector<ExtractJob>& jobs, uint64_t data_offset,
+                        const ExtractOptions& options, Manifest* manifest) {
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    auto backend = CreateIoBackend(options.Io);
+    NativeFile archive = f.Native();
+
+    // jobs are handled in windows that are read, decoded and written before the next one starts,
+    // which bounds both memory use and the number of open output files
+    const size_t windowFiles = std::max<size_t>(1, options.Io.QueueDepth * 4);
+    const size_t windowBytes = 256 * 1024 * 1024;
+
+    size_t i = 0;
+    while (i < jobs.size()) {
+        size_t j = i;
+        size_t bytes = 0;
+        while (j < jobs.size() && j - i < windowFiles && (j == i || bytes < windowBytes)) {
+            bytes += GetStoredSize(fileTable[jobs[j].Index]);
+            ++j;
+        }
+
+        std::vector<std::vector<char>> buffers(j - i);
+        for (size_t k = i; k < j; ++k) {
+            const auto& e = fileTable[jobs[k].Index];
+            const auto& outpath = jobs[k].OutPath;
+            auto& data = buffers[k - i];
+            data.resize(GetStoredSize(e));
+            uint64_t readStart = StatsStart();
+            backend->SubmitRead(
+                archive, data.data(), data.size(), data_offset + e.DataOffset,
+                [&backend, &e, &outpath, &data, &options, manifest, readStart](int64_t result) {
+                    if (result < 0) {
+                        throw "failed to read from archive";
+                    }
+                    MemoryScope scope(MemorySubsystem::FileBuffers);
+                    MemoryEntryScope entry(e.Name);
+                    RecordSince(StatPhase::Read, readStart, data.size(), e.Name);
+                    Crypt(data.data(), data.data(), data.size(), e.Key, e.Name);
+                    size_t length = DecodeExtractedFile(e, data);
+                    if (manifest) {
+                        manifest->Add(outpath, data.data(), length);
+                    }
+                    if (options.SkipUnchanged
+                        && OutputUnchanged(outpath, data.data(), length, e.Name, options)) {
+                        return;
+                    }
+
+                    RemoveExistingOutput(outpath, options);
+                    NativeFile out;
+                    if (!OpenNativeFileForWriting(out, std::filesystem::path(outpath))) {
+                        throw "failed to open output file";
+                    }
+                    if (length == 0) {
+                        CloseNativeFile(out);
+                        return;
+                    }
+                    if (options.Preallocate) {
+                        PreallocateNativeFile(out, length);
+                    }
+                    uint64_t writeStart = StatsStart();
+                    backend->SubmitWrite(out, data.data(), length, 0,
+                                         [out, writeStart, length, &e](int64_t result) {
+                                             CloseNativeFile(out);
+                                             if (result < 0) {
+                                                 throw "failed to write output file";
+                                             }
+                                             RecordSince(StatPhase::Write, writeStart, length,
+                                                         e.Name);
+                                         });
+                });
+        }
+        backend->Drain();
+        i = j;
+    }
+}
+
+uint64_t ReadFileTable(File& f, std::vector<FileTableEntry>& fileTable) {
+    MemoryScope scope(MemorySubsystem::FileTable);
+    const char* filename = "InfoData";
+    uint32_t infodata_filesize = 0;
+    const size_t infodata_offset = 0x8;
+    std::array<char, 8> infodata_info_bytes;
+
+    // header and InfoData are read front to back, so this works on streams as well
+    {
+        PhaseTimer timer(StatPhase::Read, 8, filename);
+        f.ReadAt(infodata_info_bytes.data(), 8, 0);
+    }
+
+    std::memcpy(&infodata_filesize, infodata_info_bytes.data(), 4);
+
+    // the header stores the unpadded length, but InfoData occupies a multiple of 4 bytes
+    size_t infodata_extra_bytes = infodata_filesize & 3;
+    size_t infodata_aligned_size = infodata_extra_bytes
+                                       ? (infodata_filesize + 4 - infodata_extra_bytes)
+                                       : infodata_filesize;
+
+    std::vector<char> in_data;
+    in_data.resize(infodata_aligned_size);
+    {
+        PhaseTimer timer(StatPhase::Read, in_data.size(), filename);
+        f.ReadAt(in_data.data(), in_data.size(), infodata_offset);
+    }
+
+    std::vector<char> out_data;
+    out_data.resize(in_data.size());
+
+    Crypt(out_data.data(), in_data.data(), in_data.size(), InfoDataKey, filename);
+
+    std::vector<char> decomp_data = Decompress(out_data, filename);
+    ParseFileTable(decomp_data, fileTable);
+
+    return infodata_offset + infodata_aligned_size;
+}
+
+size_t ReadRange(File& f, uint64_t dataOffset, const FileTableEntry& e, uint64_t offset,
+                 char* buffer, size_t length) {
+    if (e.Length & 0xc000'0000) {
+        throw (e.Length & 0x8000'0000) ? "not a file" : "not a stored file";
+    }
+    uint64_t size = e.Length & 0x3fff'ffff;
+    if (offset >= size) {
+        return 0;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, size - offset));
+    {
+        PhaseTimer timer(StatPhase::Read, length, e.Name);
+        if (f.ReadAt(buffer, length, dataOffset + e.DataOffset + offset) != length) {
+            throw "blob runs past the end of the archive";
+        }
+    }
+    CryptAt(buffer, buffer, length, e.Key, offset, e.Name);
+    return length;
+}
+
+std::array<unsigned char, 16> HashArchivePrefix(File& f, uint64_t& dataOffset) {
+    char header[8];
+    if (f.ReadAt(header, sizeof(header), 0) != sizeof(header)) {
+        throw "archive shorter than its header";
+    }
+    uint32_t infodataSize;
+    std::memcpy(&infodataSize, header, 4);
+    dataOffset = sizeof(header) + ((uint64_t(infodataSize) + 3) & ~uint64_t(3));
+
+    const uint64_t chunkSize = 1024 * 1024;
+    md5_state_t md5;
+    md5_init(&md5);
+    std::vector<char> buffer(static_cast<size_t>(std::min(dataOffset, chunkSize)));
+    for (uint64_t offset = 0; offset < dataOffset; offset += buffer.size()) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(buffer.size(), dataOffset - offset));
+        if (f.ReadAt(buffer.data(), chunk, offset) != chunk) {
+            throw "archive shorter than its InfoData";
+        }
+        md5_append(&md5, (const md5_byte_t*)buffer.data(), static_cast<int>(chunk));
+    }
+    std::array<unsigned char, 16> digest;
+    md5_finish(&md5, digest.data());
+    return digest;
+}
+
+void ParseFileTable(const std::vector<char>& decomp_data, std::vector<FileTableEntry>& fileTable) {
+    MemoryScope scope(MemorySubsystem::FileTable);
+
+    //{
+    //    FILE* f3 = fopen((outfilepath + "_InfoData").c_str(), "wb");
+    //    fwrite(decomp_data.data(), 1, decomp_data.size(), f3);
+    //    fclose(f3);
+    //}
+
+    {
+        uint32_t lengthData;
+        uint32_t lengthStrings;
+        std::memcpy(&lengthData, decomp_data.data(), 4);
+        std::memcpy(&lengthStrings, decomp_data.data() + 4, 4);
+
+        size_t offsetData = 8;
+        size_t offsetStrings = offsetData + lengthData;
+        size_t numberOfStrings = 0;
+
+        size_t i = offsetData;
+        while (i < offsetStrings) {
+            auto& e = fileTable.emplace_back();
+            std::memcpy(&e.NameOffset, decomp_data.data() + i, 4);
+            std::memcpy(&e.Length, decomp_data.data() + i + 4, 4);
+            std::memcpy(&e.DataOffset, decomp_data.data() + i + 8, 4);
+
+            const auto read_string = [&]() -> std::string {
+                size_t j = offsetStrings + e.NameOffset;
+                std::string n;
+                while (j < decomp_data.size()) {
+                    if (decomp_data[j] == '\0') {
+                        break;
+                    }
+                    n.push_back(decomp_data[j]);
+                    ++j;
+                }
+                return n;
+            };
+            e.Name = read_string();
+            i += 12;
+        }
+    }
+
+    // all keys at once, while the names are hot and md5_many can fill its lanes
+    std::vector<std::string_view> names;
+    for (const auto& e : fileTable) {
+        if (!(e.Length & 0x8000'0000)) {
+            names.push_back(e.Name);
+        }
+    }
+    std::vector<CryptKey> keys = DeriveKeys(names);
+    size_t key = 0;
+    for (auto& e : fileTable) {
+        if (!(e.Length & 0x8000'0000)) {
+            e.Key = keys[key++];
+        }
+    }
+}
+
+void CollectFilePaths(std::unordered_map<std::string, size_t>& paths, const std::string& outfolder,
+                      std::vector<FileTableEntry>& fileTable, size_t idx) {
+    if (idx >= fileTable.size() || fileTable[idx].Extracted) {
+        return;
+    }
+    auto& e = fileTable[idx];
+    e.Extracted = true;
+
+    std::string outpath = outfolder.empty() ? e.Name : outfolder + "/" + e.Name;
+    if (e.Length & 0x8000'0000) {
+        size_t size = e.Length & 0x3fff'ffff;
+        size_t folder_offset = e.DataOffset / 12;
+        for (size_t i = 0; i < size; ++i) {
+            CollectFilePaths(paths, outpath, fileTable, folder_offset + i);
+        }
+    } else {
+        paths.emplace(std::move(outpath), idx);
+    }
+}
+
+// Compares two stored blobs chunk by chunk, in place where the archives are mapped.
+bool SameStoredBytes(File& a, uint64_t aOffset, File& b, uint64_t bOffset, size_t length,
+                     std::string_view name) {
+    PhaseTimer timer(StatPhase::Read, length * 2, name);
+    const char* aMapped = a.MappedData();
+    const char* bMapped = b.MappedData();
+    if (aMapped && bMapped && aOffset + length <= a.Size() && bOffset + length <= b.Size()) {
+        return std::memcmp(aMapped + aOffset, bMapped + bOffset, length) == 0;
+    }
+    const size_t chunkSize = 1024 * 1024;
+    std::vector<char> aBuffer(std::min(length, chunkSize));
+    std::vector<char> bBuffer(aBuffer.size());
+    for (size_t offset = 0; offset < length; offset += chunkSize) {
+        size_t chunk = std::min(chunkSize, length - offset);
+        if (a.ReadAt(aBuffer.data(), chunk, aOffset + offset) != chunk
+            || b.ReadAt(bBuffer.data(), chunk, bOffset + offset) != chunk
+            || std::memcmp(aBuffer.data(), bBuffer.data(), chunk) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Drops the jobs for files that the archive at options.Since has at the same path with the same
+// Length and the same stored bytes. The key only depends on the name, so identical ciphertext
+// means identical contents, and nothing needs to be decrypted or inflated to tell.
+void DropUnchangedJobs(File& f, uint64_t data_offset, const std::vector<FileTableEntry>& fileTable,
+                       std::vector<ExtractJob>& jobs, const std::string& outfilepath,
+                       const ExtractOptions& options) {
+    auto old = OpenFile(std::filesystem::path(options.Since), FileMode::Read, options.Io.Files);
+    if (!old) {
+        throw "failed to open the earlier archive";
+    }
+    std::vector<FileTableEntry> oldTable;
+    uint64_t old_data_offset = ReadFileTable(*old, oldTable);
+
+    std::unordered_map<std::string, size_t> oldPaths;
+    {
+        MemoryScope scope(MemorySubsystem::PathStrings);
+        for (size_t i = 0; i < oldTable.size(); ++i) {
+            CollectFilePaths(oldPaths, outfilepath, oldTable, i);
+        }
+    }
+
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(),
+                              [&](const ExtractJob& job) {
+                                  auto it = oldPaths.find(job.OutPath);
+                                  if (it == oldPaths.end()) {
+                                      return false;
+                                  }
+                                  const auto& e = fileTable[job.Index];
+                                  const auto& o = oldTable[it->second];
+                                  return e.Length == o.Length
+                                         && SameStoredBytes(f, data_offset + e.DataOffset, *old,
+                                                            old_data_offset + o.DataOffset,
+                                                            GetStoredSize(e), e.Name);
+                              }),
+               jobs.end());
+}
+
+int ExtractArchive(File& f, const std::string& outfilepath, const ExtractOptions& options) {
+    std::vector<FileTableEntry> fileTable;
+    uint64_t data_offset = ReadFileTable(f, fileTable);
+
+    std::vector<ExtractJob> jobs;
+    {
+        MemoryScope scope(MemorySubsystem::PathStrings);
+        for (size_t i = 0; i < fileTable.size(); ++i) {
+            CollectExtractJobs(jobs, outfilepath, fileTable, i);
+        }
+    }
+
+    bool stream = options.Stream || !f.IsSeekable();
+    if (!options.Since.empty()) {
+        if (stream) {
+            throw "extracting changes since an earlier archive needs a seekable archive";
+        }
+        DropUnchangedJobs(f, data_offset, fileTable, jobs, outfilepath, options);
+    }
+
+    Manifest manifest;
+    manifest.Hash = options.Manifest;
+    manifest.Root = outfilepath;
+    Manifest* m = options.Manifest != ManifestHash::None ? &manifest : nullptr;
+
+    if (options.Order == ExtractOrder::DataOffset || stream) {
+        if (options.Io.Async && !stream) {
+            SortJobsByDataOffset(jobs, fileTable);
+            ExtractWithBackend(f, fileTable, jobs, data_offset, options, m);
+        } else {
+            ExtractInDataOrder(f, fileTable, jobs, data_offset, options, m);
+        }
+    } else if (options.Io.Async) {
+        ExtractWithBackend(f, fileTable, jobs, data_offset, options, m);
+    } else {
+        ExtractInTableOrder(f, fileTable, jobs, data_offset, options, m);
+    }
+
+    if (m && !WriteManifest(std::filesystem::path(outfilepath + ".manifest"), manifest)) {
+        throw "failed to write manifest";
+    }
+
+    return 0;
+}
+
+struct PackFileEntryInternal {
+    std::filesystem::path Path;
+    std::string Name;
+    bool IsFolder = false;
+    std::vector<PackFileEntryInternal> Children;
+};
+
+void CollectPackFileEntriesInternal(std::vector<PackFileEntryInternal>& entries,
+                                    const std::filesystem::path& p) {
+    for (const auto& entry : std::filesystem::directory_iterator(p)) {
+        if (entry.is_regular_file()) {
+            entries.emplace_back(
+                PackFileEntryInternal{entry.path(), entry.path().filename().string(), false});
+        } else if (entry.is_directory()) {
+            size_t index = entries.size();
+            auto& d = entries.emplace_back(
+                PackFileEntryInternal{entry.path(), entry.path().filename().string(), true});
+
+            CollectPackFileEntriesInternal(d.Children, entry.path());
+
+            std::stable_sort(d.Children.begin(), d.Children.end(),
+                             [](const PackFileEntryInternal& lhs,
+                                const PackFileEntryInternal& rhs) { return lhs.Name > rhs.Name; });
+        }
+    }
+}
+
+void FlattenPackFileEntries(std::vector<PackFileEntry>& flat,
+                            const std::vector<PackFileEntryInternal>& entries) {
+    size_t startIndex = flat.size();
+    for (const auto& e : entries) {
+        auto& f = flat.emplace_back();
+        f.Path = e.Path;
+        f.Name = e.Name;
+        f.IsFolder = e.IsFolder;
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& e = entries[i];
+        auto& f = flat[startIndex + i];
+        if (e.IsFolder) {
+            f.Length = e.Children.size();
+            f.Offset = flat.size();
+            FlattenPackFileEntries(flat, e.Children);
+        }
+    }
+}
+
+std::vector<PackFileEntry> CollectPackFileEntries(const std::filesystem::path& p) {
+    std::vector<PackFileEntryInternal> entries;
+    CollectPackFileEntriesInternal(entries, p);
+    std::vector<PackFileEntry> flat;
+    FlattenPackFileEntries(flat, entries);
+    return flat;
+}
+
+void EncodePackFileEntry(PackFileEntry& entry, uint64_t indexSpan) {
+    bool shouldCompress = !(ends_with_case_insensitive(entry.Name, ".pck")
+                            || ends_with_case_insensitive(entry.Name, ".webp")
+                            || ends_with_case_insensitive(entry.Name, ".webm")
+                            || ends_with_case_insensitive(entry.Name, ".png")
+                            || ends_with_case_insensitive(entry.Name, ".ogg")
+                            || ends_with_case_insensitive(entry.Name, ".opus"));
+
+    entry.IsRead = true;
+    if (shouldCompress) {
+        auto compressed = Compress(entry.Data, entry.Name);
+        if (compressed.size() < entry.Data.size()) {
+            if (indexSpan > 0 && entry.Data.size() > indexSpan) {
+                entry.Points =
+                    BuildInflatePoints(compressed.data() + 4, compressed.size() - 4, indexSpan);
+            }
+            entry.Data = std::move(compressed);
+            entry.IsCompressed = true;
+        }
+    }
+
+    entry.Length = entry.Data.size();
+    auto encrypted = Encrypt(entry.Data, entry.Key, entry.Name);
+    entry.Data = std::move(encrypted);
+    entry.IsEncrypted = true;
+}
+
+void ReadPackFileEntries(std::vector<PackFileEntry>& entries, const PackOptions& options) {
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    for (auto& entry : entries) {
+        if (!entry.IsFolder) {
+            MemoryEntryScope memoryEntry(entry.Name);
+            {
+                PhaseTimer timer(StatPhase::Read, 0, entry.Name);
+                auto f2 = OpenFile(entry.Path, FileMode::Read, options.Io.Files);
+                if (!f2) {
+                    throw "failed to open input file";
+                }
+                entry.Data.resize(static_cast<size_t>(f2->Size()));
+                entry.Data.resize(f2->ReadAt(entry.Data.data(), entry.Data.size(), 0));
+                timer.SetBytes(entry.Data.size());
+            }
+
+            EncodePackFileEntry(entry, options.IndexSpan);
+        }
+    }
+}
+
+void ReadPackFileEntriesWithBackend(std::vector<PackFileEntry>& entries, IoBackend& backend,
+                                    const PackOptions& options) {
+    // like extraction, files are read in windows to limit the number of open handles
+    const size_t windowFiles = std::max<size_t>(1, options.Io.QueueDepth * 4);
+    const uint64_t indexSpan = options.IndexSpan;
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+
+    size_t i = 0;
+    while (i < entries.size()) {
+        size_t submitted = 0;
+        for (; i < entries.size() && submitted < windowFiles; ++i) {
+            auto& entry = entries[i];
+            if (entry.IsFolder) {
+                continue;
+            }
+
+            NativeFile in;
+            if (!OpenNativeFileForReading(in, entry.Path)) {
+                throw "failed to open input file";
+            }
+            entry.Data.resize(std::filesystem::file_size(entry.Path));
+            if (entry.Data.empty()) {
+                CloseNativeFile(in);
+                MemoryEntryScope memoryEntry(entry.Name);
+                EncodePackFileEntry(entry, indexSpan);
+                continue;
+            }
+            uint64_t readStart = StatsStart();
+            backend.SubmitRead(in, entry.Data.data(), entry.Data.size(), 0,
+                               [in, &entry, readStart, indexSpan](int64_t result) {
+                                   CloseNativeFile(in);
+                                   if (result < 0) {
+                                       throw "failed to read input file";
+                                   }
+                                   RecordSince(StatPhase::Read, readStart, entry.Data.size(),
+                                               entry.Name);
+                                   MemoryScope scope(MemorySubsystem::FileBuffers);
+                                   MemoryEntryScope memoryEntry(entry.Name);
+                                   EncodePackFileEntry(entry, indexSpan);
+                               });
+            ++submitted;
+        }
+        backend.Drain();
+    }
+}
+
+void WritePackedArchive(File& f, const std::string& outfilepath,
+                        std::vector<PackFileEntry>& entries, const PackOptions& options,
+                        IoBackend* backend) {
+    uint64_t totalLength = 0;
+    for (auto& entry : entries) {
+        if (!entry.IsFolder) {
+            uint64_t extraBytes = entry.Length & 3;
+            uint64_t alignedLength = extraBytes ? (entry.Length + 4 - extraBytes) : entry.Length;
+            entry.Offset = totalLength;
+            totalLength += alignedLength;
+        }
+    }
+
+    // from here on the allocations are InfoData's
+    MemoryScope tableScope(MemorySubsystem::FileTable);
+
+    struct HeaderEntry {
+        uint32_t NameOffset; // offset into the strings section of InfoData
+        uint32_t Length;     // two highest bits are flags
+        uint32_t DataOffset; // offset into the data.bin
+    };
+    std::vector<HeaderEntry> headerData;
+    std::vector<char> headerStrings;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& entry = entries[i];
+
+        const auto write_string = [&headerStrings](std::string_view sv) -> size_t {
+            size_t pos = headerStrings.size();
+            for (char c : sv) {
+                headerStrings.push_back(c);
+            }
+            headerStrings.push_back(0);
+            return pos;
+        };
+
+        size_t nameOffset = write_string(entry.Name);
+        uint32_t nameOffset32 = static_cast<uint32_t>(nameOffset);
+        if (nameOffset != static_cast<size_t>(nameOffset32)) {
+            throw "string table too big";
+        }
+        uint32_t length = 0;
+        uint32_t dataOffset = 0;
+        if (entry.IsFolder) {
+            if (entry.Length > 0x3fff'ffffu) {
+                throw "too many files in folder";
+            }
+
+            length = static_cast<uint32_t>(entry.Length | 0x8000'0000u);
+            uint64_t dataOffset64 = entry.Offset * 12;
+            dataOffset = static_cast<uint32_t>(dataOffset64);
+            if (dataOffset != static_cast<uint64_t>(dataOffset64)) {
+                throw "file table too big";
+            }
+        } else {
+            if (entry.Length > 0x3fff'ffffu) {
+                throw "single file too big";
+            }
+
+            length = static_cast<uint32_t>(entry.Length);
+            if (entry.IsCompressed) {
+                length = length | 0x4000'0000u;
+            }
+            uint64_t dataOffset64 = entry.Offset;
+            dataOffset = static_cast<uint32_t>(dataOffset64);
+            if (dataOffset != static_cast<uint64_t>(dataOffset64)) {
+                throw "combined files too big";
+            }
+        }
+
+        headerData.emplace_back(HeaderEntry{nameOffset32, length, dataOffset});
+    }
+
+    std::vector<char> infodata;
+    size_t infodataLength = 8 + headerData.size() * 12 + headerStrings.size();
+    infodata.resize(infodataLength);
+    uint32_t headerDataLength = headerData.size() * 12;
+    uint32_t headerStringsLength = headerStrings.size();
+    std::memcpy(infodata.data(), &headerDataLength, 4);
+    std::memcpy(infodata.data() + 4, &headerStringsLength, 4);
+    for (size_t i = 0; i < headerData.size(); ++i) {
+        std::memcpy(infodata.data() + 8 + i * 12, &headerData[i].NameOffset, 4);
+        std::memcpy(infodata.data() + 8 + i * 12 + 4, &headerData[i].Length, 4);
+        std::memcpy(infodata.data() + 8 + i * 12 + 8, &headerData[i].DataOffset, 4);
+    }
+    std::memcpy(infodata.data() + 8 + headerData.size() * 12, headerStrings.data(),
+                headerStrings.size());
+
+    auto infodataCompressed = Compress(infodata, "InfoData");
+    size_t infodataCompressedLength = infodataCompressed.size();
+    size_t infodataExtraBytes = infodataCompressedLength & 3;
+    size_t infodataAlignedLength = infodataExtraBytes
+                                       ? (infodataCompressedLength + 4 - infodataExtraBytes)
+                                       : infodataCompressedLength;
+    infodataCompressed.resize(infodataAlignedLength);
+    std::vector<char> infodataEncrypted;
+    infodataEncrypted.resize(infodataCompressed.size());
+    Crypt(infodataEncrypted.data(), infodataCompressed.data(), infodataCompressed.size(),
+          InfoDataKey, "InfoData");
+
+
+    // header
+    std::array<char, 8> infodata_info_bytes{};
+    uint32_t infodata_filesize = infodataCompressedLength;
+    uint32_t content_filesize = totalLength;
+    std::memcpy(infodata_info_bytes.data(), &infodata_filesize, 4);
+    std::memcpy(infodata_info_bytes.data() + 4, &content_filesize, 4);
+
+    if (options.IndexSpan > 0) {
+        // the index is keyed by the header and InfoData, which are final by now
+        InflateIndex index;
+        index.Span = options.IndexSpan;
+        md5_state_t md5;
+        md5_init(&md5);
+        md5_append(&md5, (const md5_byte_t*)infodata_info_bytes.data(),
+                   static_cast<int>(infodata_info_bytes.size()));
+        md5_append(&md5, (const md5_byte_t*)infodataEncrypted.data(),
+                   static_cast<int>(infodataEncrypted.size()));
+        md5_finish(&md5, index.Archive.data());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!entries[i].Points.empty()) {
+                auto& blob = index.Blobs.emplace_back();
+                blob.DataOffset = headerData[i].DataOffset;
+                blob.Length = headerData[i].Length;
+                blob.Points = std::move(entries[i].Points);
+            }
+        }
+        if (!WriteInflateIndex(std::filesystem::path(outfilepath + ".idx"), index)) {
+            throw "failed to write inflate index";
+        }
+    }
+
+    if (options.Preallocate) {
+        f.Preallocate(infodata_info_bytes.size() + infodataEncrypted.size() + totalLength);
+    }
+
+    if (backend) {
+        // every piece has a known position, so they can all be written at once
+        NativeFile out = f.Native();
+        const auto write = [&](const char* data, size_t size, uint64_t offset,
+                               std::string_view name) {
+            uint64_t writeStart = StatsStart();
+            backend->SubmitWrite(out, data, size, offset,
+                                 [writeStart, size, name](int64_t result) {
+                                     if (result < 0) {
+                                         throw "failed to write archive";
+                                     }
+                                     RecordSince(StatPhase::Write, writeStart, size, name);
+                                 });
+        };
+        uint64_t dataOffset = infodata_info_bytes.size() + infodataEncrypted.size();
+        write(infodata_info_bytes.data(), infodata_info_bytes.size(), 0, "header");
+        write(infodataEncrypted.data(), infodataEncrypted.size(), infodata_info_bytes.size(),
+              "InfoData");
+        for (auto& entry : entries) {
+            if (!entry.IsFolder && !entry.Data.empty()) {
+                write(entry.Data.data(), entry.Data.size(), dataOffset + entry.Offset,
+                      entry.Name);
+            }
+        }
+        backend->Drain();
+        return;
+    }
+
+    uint64_t position = 0;
+    const auto write = [&](const char* data, size_t size, std::string_view name) {
+        PhaseTimer timer(StatPhase::Write, size, name);
+        f.WriteAt(data, size, position);
+        position += size;
+    };
+    write(infodata_info_bytes.data(), infodata_info_bytes.size(), "header");
+
+    // infodata
+    write(infodataEncrypted.data(), infodataEncrypted.size(), "InfoData");
+
+    // files
+    for (auto& entry : entries) {
+        if (!entry.IsFolder) {
+            write(entry.Data.data(), entry.Data.size(), entry.Name);
+        }
+    }
+}
+
+int PackArchive(const std::string& infilepath, const std::string& outfilepath,
+                const PackOptions& options) {
+    auto f = OpenFile(std::filesystem::path(outfilepath), FileMode::Write, options.Io.Files);
+    if (!f) {
+        return -1;
+    }
+
+    std::vector<PackFileEntry> entries;
+    {
+        MemoryScope scope(MemorySubsystem::PathStrings);
+        entries = CollectPackFileEntries(std::filesystem::path(infilepath));
+    }
+
+    {
+        std::vector<std::string_view> names;
+        for (const auto& entry : entries) {
+            if (!entry.IsFolder) {
+                names.push_back(entry.Name);
+            }
+        }
+        std::vector<CryptKey> keys = DeriveKeys(names);
+        size_t key = 0;
+        for (auto& entry : entries) {
+            if (!entry.IsFolder) {
+                entry.Key = keys[key++];
+            }
+        }
+    }
+
+    std::unique_ptr<IoBackend> backend;
+    if (options.Io.Async) {
+        backend = CreateIoBackend(options.Io);
+        ReadPackFileEntriesWithBackend(entries, *backend, options);
+    } else {
+        ReadPackFileEntries(entries, options);
+    }
+
+    WritePackedArchive(*f, outfilepath, entries, options, backend.get());
+    return 0;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "fileio.h"
+#include "inflateindex.h"
+#include "iobackend.h"
+#include "keys.h"
+#include "manifest.h"
+
+// Reading and writing archives: a header, the encrypted and compressed InfoData holding the file
+// table, and the data section with one encrypted (and possibly compressed) blob per file.
+
+// Length flags: 0x8000'0000 marks a folder, whose DataOffset / 12 is the index of its first child
+// and whose size is its number of children; 0x4000'0000 marks a compressed file.
+struct FileTableEntry {
+    bool Extracted = false;
+    std::string Name;
+
+    uint32_t NameOffset; // offset into the strings section of InfoData
+    uint32_t Length;     // two highest bits are flags
+    uint32_t DataOffset; // offset into the data.bin
+
+    CryptKey Key{}; // files only, set by ReadFileTable
+};
+
+enum class ExtractOrder {
+    Table,      // one read per file, in the order the file table lists them
+    DataOffset, // files sorted by their position in data.bin, neighbouring reads merged
+};
+
+struct ExtractOptions {
+    ExtractOrder Order = ExtractOrder::Table;
+
+    // neighbouring blobs are read together if at most this many unused bytes lie between them
+    size_t CoalesceGap = 64 * 1024;
+
+    // merged reads don't grow beyond this, though a single bigger blob is still read in one go
+    size_t CoalesceLimit = 16 * 1024 * 1024;
+
+    // the input can't seek (stdin, a pipe); implies DataOffset order
+    bool Stream = false;
+
+    // with Io.Async, reads and writes go through an IoBackend instead of stdio; not for streams
+    IoOptions Io;
+
+    // reserve each output file's final size before writing it, so it isn't fragmented
+    bool Preallocate = false;
+
+    // delete existing output files instead of truncating them; ext4 flushes a file to disk when
+    // it's closed after having been truncated, which makes re-extraction crawl
+    bool UnlinkExisting = false;
+
+    // hash each file while it's decoded and list them in <outfolder>.manifest
+    ManifestHash Manifest = ManifestHash::None;
+
+    // leave output files that already hold exactly the decoded contents alone, so that their
+    // modification times stay put
+    bool SkipUnchanged = false;
+
+    // an earlier version of the archive; only files it doesn't have at the same path with the
+    // same stored bytes are extracted. Not for streams
+    std::string Since;
+};
+
+struct PackOptions {
+    IoOptions Io;
+
+    // reserve the archive's final size before writing it
+    bool Preallocate = false;
+
+    // if not 0, write <archive>.idx with inflate points this many bytes apart for the compressed
+    // files bigger than that, see inflateindex.h
+    uint64_t IndexSpan = 0;
+};
+
+// XORs length bytes with the key; encrypting and decrypting are the same operation. length must
+// be a multiple of 4. filename is only for the stats.
+void Crypt(char* dst, const char* src, size_t length, const CryptKey& key,
+           std::string_view filename);
+void Crypt(char* dst, char* src, size_t length, std::string_view filename);
+
+// Like Crypt, for bytes that start phase bytes into a blob: the key repeats every 16 bytes, so it's
+// turned to phase % 16 first. Any length.
+void CryptAt(char* dst, const char* src, size_t length, const CryptKey& key, uint64_t phase,
+             std::string_view filename);
+
+// Pads to a multiple of 4 and encrypts.
+std::vector<char> Encrypt(const std::vector<char>& in_data, const CryptKey& key,
+                          std::string_view filename);
+std::vector<char> Encrypt(const std::vector<char>& in_data, std::string_view filename);
+
+// Blobs are stored as the uncompressed size followed by a zlib stream.
+std::vector<char> Decompress(const std::vector<char>& out_data, std::string_view filename);
+std::vector<char> Compress(const std::vector<char>& in_data, std::string_view filename);
+
+// Like Decompress, but throws if the stream is damaged, fails its Adler-32 check or doesn't
+// inflate to exactly the size in its prefix. A prefix deflate can't reach from the stream's
+// length is rejected before anything is allocated.
+std::vector<char> DecompressChecked(const char* data, size_t size, std::string_view filename);
+
+// Reads up to length bytes at offset of a stored (not compressed) file with a single positioned
+// read and decrypts them in place, without touching the rest of the blob. Any offset and length;
+// returns how many bytes there were. Throws for folders and compressed files.
+size_t ReadRange(File& f, uint64_t dataOffset, const FileTableEntry& e, uint64_t offset,
+                 char* buffer, size_t length);
+
+// Reads the header and InfoData into fileTable and returns where the data section starts.
+uint64_t ReadFileTable(File& f, std::vector<FileTableEntry>& fileTable);
+
+// The MD5 of an archive's header and InfoData, which tells archives apart without reading their
+// data sections; patches and inflate indexes record it. Also returns where the data section
+// starts.
+std::array<unsigned char, 16> HashArchivePrefix(File& f, uint64_t& dataOffset);
+
+// Fills fileTable from decompressed InfoData and derives the keys. Names are read up to the end
+// of InfoData but nothing else is checked, see VerifyArchive() for that.
+void ParseFileTable(const std::vector<char>& infodata, std::vector<FileTableEntry>& fileTable);
+
+// Like the extraction's walk over the folders, but only maps the path of each file below outfolder
+// to its index, without creating any directories. An empty outfolder gives archive-relative paths.
+// Marks the entries it visits as Extracted.
+void CollectFilePaths(std::unordered_map<std::string, size_t>& paths, const std::string& outfolder,
+                      std::vector<FileTableEntry>& fileTable, size_t idx);
+
+int ExtractArchive(File& f, const std::string& outfilepath, const ExtractOptions& options);
+int PackArchive(const std::string& infilepath, const std::string& outfilepath,
+                const PackOptions& options);
+
+// A file or folder of an archive being packed. Entries are laid out as the file table lists them:
+// the children of each folder next to each other, Offset being the index of a folder's first child
+// and Length its number of children until WritePackedArchive() turns them into the table's fields.
+struct PackFileEntry {
+    std::filesystem::path Path; // where the contents come from, for PackArchive()
+    uint64_t Length = 0;
+    uint64_t Offset = 0;
+    std::string Name;
+    bool IsFolder = false;
+    CryptKey Key{};
+
+    bool IsRead = false;
+    bool IsCompressed = false;
+    bool IsEncrypted = false;
+    std::vector<char> Data;
+    std::vector<InflatePoint> Points;
+};
+
+// Compresses (where worthwhile) and encrypts the file contents in entry.Data. Compressed files
+// bigger than indexSpan get inflate points, unless it's 0.
+void EncodePackFileEntry(PackFileEntry& entry, uint64_t indexSpan);
+
+// Writes encoded entries to f as an archive, through backend if there is one, and the inflate
+// index to outfilepath + ".idx" with options.IndexSpan.
+void WritePackedArchive(File& f, const std::string& outfilepath,
+                        std::vector<PackFileEntry>& entries, const PackOptions& options,
+                        IoBackend* backend);
@@ -0,0 +1,161 @@
+#include "archivereader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "memstats.h"
+#include "stats.h"
+#include "verify.h"
+
+std::unique_ptr<ArchiveReader> ArchiveReader::Open(const std::filesystem::path& path,
+                                                   const ReaderOptions& options) {
+    auto f = OpenFile(path, FileMode::Read, options.Files);
+    if (!f) {
+        return nullptr;
+    }
+    std::unique_ptr<ArchiveReader> reader(new ArchiveReader());
+    reader->Path = path;
+    reader->F = std::move(f);
+    // the archive may come from anywhere, so it's checked the way --verify checks it before
+    // anything follows its file table
+    std::unordered_map<std::string, size_t> paths;
+    {
+        std::vector<std::string> tablePaths;
+        reader->DataOffset = ReadCheckedFileTable(*reader->F, reader->FileTable, tablePaths);
+        MemoryScope scope(MemorySubsystem::PathStrings);
+        for (size_t i = 0; i < reader->FileTable.size(); ++i) {
+            if (!(reader->FileTable[i].Length & 0x8000'0000)) {
+                paths.emplace(std::move(tablePaths[i]), i);
+            }
+        }
+    }
+    uint64_t dataOffset = 0;
+    reader->Digest = HashArchivePrefix(*reader->F, dataOffset);
+    for (auto& [filePath, idx] : paths) {
+        const auto& e = reader->FileTable[idx];
+        auto& entry = reader->Files.emplace_back();
+        entry.Path = filePath;
+        entry.Index = idx;
+        entry.Compressed = (e.Length & 0x4000'0000) != 0;
+        entry.StoredSize = e.Length & 0x3fff'ffff;
+    }
+    std::sort(reader->Files.begin(), reader->Files.end(),
+              [](const ArchiveEntry& lhs, const ArchiveEntry& rhs) { return lhs.Path < rhs.Path; });
+    for (size_t i = 0; i < reader->Files.size(); ++i) {
+        reader->ByPath.emplace(reader->Files[i].Path, i);
+    }
+
+    // points are looked up by table index from here on
+    reader->Points.resize(reader->FileTable.size());
+    InflateIndex index;
+    index.Archive = reader->Digest;
+    std::filesystem::path indexPath(path);
+    indexPath += ".idx";
+    if (!ReadInflateIndex(indexPath, index)) {
+        index.Span = options.IndexSpan;
+    }
+    reader->Span = index.Span;
+    std::unordered_map<uint64_t, size_t> byBlob;
+    for (const auto& file : reader->Files) {
+        const auto& e = reader->FileTable[file.Index];
+        byBlob.emplace((uint64_t(e.DataOffset) << 32) | e.Length, file.Index);
+    }
+    for (auto& blob : index.Blobs) {
+        auto it = byBlob.find((uint64_t(blob.DataOffset) << 32) | blob.Length);
+        if (it != byBlob.end()) {
+            reader->Points[it->second] =
+                std::make_shared<const std::vector<InflatePoint>>(std::move(blob.Points));
+        }
+    }
+    return reader;
+}
+
+const ArchiveEntry* ArchiveReader::Find(std::string_view path) const {
+    auto it = ByPath.find(std::string(path));
+    return it == ByPath.end() ? nullptr : &Files[it->second];
+}
+
+uint64_t ArchiveReader::Size(const ArchiveEntry& entry) {
+    if (!entry.Compressed) {
+        return entry.StoredSize;
+    }
+    const auto& e = FileTable[entry.Index];
+    if (entry.StoredSize < 4) {
+        throw "compressed blob shorter than its size prefix";
+    }
+    char prefix[4];
+    if (F->ReadAt(prefix, 4, DataOffset + e.DataOffset) != 4) {
+        throw "blob runs past the end of the archive";
+    }
+    Crypt(prefix, prefix, 4, e.Key, e.Name);
+    uint32_t size;
+    std::memcpy(&size, prefix, 4);
+    return size;
+}
+
+size_t ArchiveReader::Read(const ArchiveEntry& entry, uint64_t offset, char* buffer,
+                           size_t length) {
+    std::shared_ptr<const std::vector<InflatePoint>> points;
+    {
+        std::lock_guard<std::mutex> lock(PointsMutex);
+        points = Points[entry.Index];
+    }
+    std::vector<InflatePoint> made;
+    size_t read = ReadEntryRange(*F, DataOffset, FileTable[entry.Index], points.get(), Span,
+                                 offset, buffer, length, points ? nullptr : &made);
+    if (!made.empty()) {
+        std::lock_guard<std::mutex> lock(PointsMutex);
+        auto& kept = Points[entry.Index];
+        if (!kept) {
+            kept = std::make_shared<const std::vector<InflatePoint>>(std::move(made));
+            PointsChanged = true;
+        }
+    }
+    return read;
+}
+
+std::vector<char> ArchiveReader::Read(const ArchiveEntry& entry) {
+    const auto& e = FileTable[entry.Index];
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    if (!entry.Compressed) {
+        std::vector<char> data(static_cast<size_t>(entry.StoredSize));
+        data.resize(ReadRange(*F, DataOffset, e, 0, data.data(), data.size()));
+        return data;
+    }
+
+    // the whole blob is inflated in one go; access points would only slow that down
+    std::vector<char> blob((static_cast<size_t>(entry.StoredSize) + 3) & ~size_t(3));
+    {
+        PhaseTimer timer(StatPhase::Read, blob.size(), e.Name);
+        if (F->ReadAt(blob.data(), blob.size(), DataOffset + e.DataOffset) != blob.size()) {
+            throw "blob runs past the end of the archive";
+        }
+    }
+    Crypt(blob.data(), blob.data(), blob.size(), e.Key, e.Name);
+    return DecompressChecked(blob.data(), static_cast<size_t>(entry.StoredSize), e.Name);
+}
+
+bool ArchiveReader::SaveIndex() {
+    std::lock_guard<std::mutex> lock(PointsMutex);
+    if (!PointsChanged) {
+        return true;
+    }
+    InflateIndex index;
+    index.Archive = Digest;
+    index.Span = Span;
+    for (size_t i = 0; i < Points.size(); ++i) {
+        if (Points[i]) {
+            auto& blob = index.Blobs.emplace_back();
+            blob.DataOffset = FileTable[i].DataOffset;
+            blob.Length = FileTable[i].Length;
+            blob.Points = *Points[i];
+        }
+    }
+    std::filesystem::path indexPath(Path);
+    indexPath += ".idx";
+    if (!WriteInflateIndex(indexPath, index)) {
+        return false;
+    }
+    PointsChanged = false;
+    return true;
+}
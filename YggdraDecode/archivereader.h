@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "archive.h"
+#include "fileio.h"
+#include "inflateindex.h"
+
+// An archive opened for reading files out of it in-process, one at a time or in slices, without
+// extracting it. The CLI's --read and the C API in yggdra.h go through it. Everything but
+// destruction may be called from several threads at once.
+struct ArchiveEntry {
+    std::string Path;        // inside the archive, '/'-separated
+    size_t Index = 0;        // in the file table
+    bool Compressed = false;
+    uint64_t StoredSize = 0; // the blob's size, size prefix included for compressed files
+};
+
+struct ReaderOptions {
+    FileBackend Files = FileBackend::Mmap;
+
+    // reads of big compressed files leave access points this many bytes apart, unless the
+    // archive's inflate index says otherwise
+    uint64_t IndexSpan = 1024 * 1024;
+};
+
+class ArchiveReader {
+public:
+    // nullptr if the file can't be opened; throws if it isn't an archive or its file table is
+    // damaged. Picks up the inflate index next to the archive, if there is one for it.
+    static std::unique_ptr<ArchiveReader> Open(const std::filesystem::path& path,
+                                               const ReaderOptions& options = {});
+
+    // Every file, in path order.
+    const std::vector<ArchiveEntry>& Entries() const {
+        return Files;
+    }
+
+    // nullptr if there's no file at path.
+    const ArchiveEntry* Find(std::string_view path) const;
+
+    // How many bytes the file reads as; compressed files carry it in their blob.
+    uint64_t Size(const ArchiveEntry& entry);
+
+    // Reads up to length bytes at offset into buffer and returns how many there were. Stored
+    // files take a single read into buffer; compressed ones are inflated from the closest access
+    // point, see ReadEntryRange().
+    size_t Read(const ArchiveEntry& entry, uint64_t offset, char* buffer, size_t length);
+
+    // The whole file.
+    std::vector<char> Read(const ArchiveEntry& entry);
+
+    // Writes the access points reads have made to the inflate index next to the archive. Does
+    // nothing if they haven't made any; false if the index can't be written.
+    bool SaveIndex();
+
+    File& Archive() {
+        return *F;
+    }
+    const std::vector<FileTableEntry>& Table() const {
+        return FileTable;
+    }
+
+private:
+    ArchiveReader() = default;
+
+    std::filesystem::path Path;
+    std::unique_ptr<File> F;
+    uint64_t DataOffset = 0;
+    std::vector<FileTableEntry> FileTable;
+    std::vector<ArchiveEntry> Files;
+    std::unordered_map<std::string, size_t> ByPath; // index into Files
+    std::array<unsigned char, 16> Digest{}; // see HashArchivePrefix()
+    uint64_t Span = 0;
+
+    // access points by file table index, from the inflate index or made by reads since. Two
+    // threads may make a file's points at the same time; the first to finish keeps them
+    std::mutex PointsMutex; // guards Points and PointsChanged
+    std::vector<std::shared_ptr<const std::vector<InflatePoint>>> Points;
+    bool PointsChanged = false;
+};
@@ -0,0 +1,138 @@
+#include "archivewriter.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "iobackend.h"
+#include "keys.h"
+#include "memstats.h"
+#include "stats.h"
+
+ArchiveWriter::ArchiveWriter(const PackOptions& options) : Options(options) {
+    Nodes.emplace_back().IsFolder = true;
+}
+
+size_t ArchiveWriter::Folder(std::string_view path) {
+    if (path.empty()) {
+        return 0;
+    }
+    auto it = Paths.find(std::string(path));
+    if (it != Paths.end()) {
+        if (!Nodes[it->second].IsFolder) {
+            throw "path goes through a file";
+        }
+        return it->second;
+    }
+    size_t slash = path.rfind('/');
+    size_t parent = Folder(slash == std::string_view::npos ? std::string_view()
+                                                           : path.substr(0, slash));
+    std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    if (name.empty()) {
+        throw "empty folder name in path";
+    }
+    size_t idx = Nodes.size();
+    auto& node = Nodes.emplace_back();
+    node.IsFolder = true;
+    node.Entry.Name = std::string(name);
+    node.Entry.IsFolder = true;
+    Nodes[parent].Children.push_back(idx);
+    Paths.emplace(std::string(path), idx);
+    return idx;
+}
+
+void ArchiveWriter::Add(std::string_view path, std::vector<char> data) {
+    size_t slash = path.rfind('/');
+    std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    if (name.empty()) {
+        throw "empty file name in path";
+    }
+    if (Paths.count(std::string(path))) {
+        throw "path already in the archive";
+    }
+    size_t parent = Folder(slash == std::string_view::npos ? std::string_view()
+                                                           : path.substr(0, slash));
+
+    PackFileEntry entry;
+    entry.Name = std::string(name);
+    entry.Key = DeriveKey(entry.Name);
+    {
+        MemoryScope scope(MemorySubsystem::FileBuffers);
+        MemoryEntryScope memoryEntry(entry.Name);
+        entry.Data = std::move(data);
+        EncodePackFileEntry(entry, Options.IndexSpan);
+    }
+    size_t idx = Nodes.size();
+    Nodes.emplace_back().Entry = std::move(entry);
+    Nodes[parent].Children.push_back(idx);
+    Paths.emplace(std::string(path), idx);
+    ++Files;
+}
+
+void ArchiveWriter::Add(std::string_view path, const char* data, size_t size) {
+    Add(path, std::vector<char>(data, data + size));
+}
+
+void ArchiveWriter::Add(std::string_view path, File& source) {
+    const size_t chunkSize = 1024 * 1024;
+    std::vector<char> data;
+    {
+        MemoryScope scope(MemorySubsystem::FileBuffers);
+        if (source.IsSeekable()) {
+            data.reserve(static_cast<size_t>(source.Size()));
+        }
+        size_t length = 0;
+        while (true) {
+            data.resize(length + chunkSize);
+            PhaseTimer timer(StatPhase::Read, 0, path);
+            size_t got = source.ReadAt(data.data() + length, chunkSize, length);
+            timer.SetBytes(got);
+            length += got;
+            if (got < chunkSize) {
+                break;
+            }
+        }
+        data.resize(length);
+    }
+    Add(path, std::move(data));
+}
+
+// Like FlattenPackFileEntries(): a folder's children go next to each other, then the children of
+// each of them that's a folder.
+void ArchiveWriter::Flatten(std::vector<PackFileEntry>& flat, size_t folder) {
+    std::vector<size_t> children = Nodes[folder].Children;
+    std::sort(children.begin(), children.end(), [this](size_t lhs, size_t rhs) {
+        return Nodes[lhs].Entry.Name > Nodes[rhs].Entry.Name;
+    });
+    size_t start = flat.size();
+    for (size_t child : children) {
+        flat.push_back(std::move(Nodes[child].Entry));
+    }
+    for (size_t i = 0; i < children.size(); ++i) {
+        if (Nodes[children[i]].IsFolder) {
+            flat[start + i].Length = Nodes[children[i]].Children.size();
+            flat[start + i].Offset = flat.size();
+            Flatten(flat, children[i]);
+        }
+    }
+}
+
+bool ArchiveWriter::Finalize(const std::filesystem::path& outpath) {
+    auto f = OpenFile(outpath, FileMode::Write, Options.Io.Files);
+    if (!f) {
+        return false;
+    }
+    std::vector<PackFileEntry> flat;
+    Flatten(flat, 0);
+    std::unique_ptr<IoBackend> backend;
+    if (Options.Io.Async) {
+        backend = CreateIoBackend(Options.Io);
+    }
+    WritePackedArchive(*f, outpath.string(), flat, Options, backend.get());
+
+    Nodes.clear();
+    Nodes.emplace_back().IsFolder = true;
+    Paths.clear();
+    Files = 0;
+    return true;
+}
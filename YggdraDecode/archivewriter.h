@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "archive.h"
+#include "fileio.h"
+
+// Builds an archive from files added one at a time, from memory or from a stream, where
+// PackArchive() packs a folder. Each file is compressed and encrypted as it's added, so the
+// writer holds what the archive will; Finalize() lays it out and writes it. Folders are made from
+// the paths, and the children of each, the top level's included, are listed by name descending.
+// PackArchive() sorts subfolders that way too but leaves the top level in directory order, so the
+// two can lay out the same files differently; --diff finds no changes between them.
+class ArchiveWriter {
+public:
+    explicit ArchiveWriter(const PackOptions& options = {});
+
+    // path is '/'-separated. Throws if it's empty, already taken, or goes through a file.
+    void Add(std::string_view path, std::vector<char> data);
+    void Add(std::string_view path, const char* data, size_t size);
+
+    // Reads source until it ends, so streams work too.
+    void Add(std::string_view path, File& source);
+
+    size_t FileCount() const {
+        return Files;
+    }
+
+    // Writes the archive to outpath, and its inflate index with PackOptions::IndexSpan. False if
+    // outpath can't be created. The writer is empty again afterwards.
+    bool Finalize(const std::filesystem::path& outpath);
+
+private:
+    struct Node {
+        bool IsFolder = false;
+        std::vector<size_t> Children; // into Nodes
+        PackFileEntry Entry;          // the name, and for files the encoded contents
+    };
+
+    // The folder at path, made along with its parents if need be.
+    size_t Folder(std::string_view path);
+    void Flatten(std::vector<PackFileEntry>& flat, size_t folder);
+
+    PackOptions Options;
+    std::vector<Node> Nodes;                      // Nodes[0] is the root
+    std::unordered_map<std::string, size_t> Paths; // everything added so far, into Nodes
+    size_t Files = 0;
+};
@@ -16,6 +16,10 @@
   first call get_crc_table() to initialize the tables before allowing more than
   one thread to use crc32().
 
+  Altered for YggdraDecode: on x86-64, crc32_z() folds with PCLMULQDQ when
+  the processor has it, which is checked at run time; #define NO_PCLMUL to
+  build without it. crc32_combine() and the tables are unchanged.
+
   MAKECRCH can be #defined to write out crc32.h. A main() routine is also
   produced, so that this one source file can be compiled to an executable.
  */
@@ -103,6 +107,14 @@
 #  define ARMCRC32
 #endif
 
+/* On x86-64, fold with the carry-less multiply instruction when the processor
+   has it. It is checked for at run time, so the build needs no -mpclmul. */
+#if !defined(ARMCRC32) && !defined(NO_PCLMUL) && \
+    (defined(__x86_64__) || defined(_M_X64)) && \
+    (defined(__GNUC__) || defined(_MSC_VER))
+#  define PCLMULCRC32
+#endif
+
 /* Local functions. */
 local z_crc_t multmodp OF((z_crc_t a, z_crc_t b));
 local z_crc_t x2nmodp OF((z_off64_t n, unsigned k));
@@ -744,6 +756,143 @@ local z_word_t crc_word_big(data)
 
 #endif
 
+#ifdef PCLMULCRC32
+
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#  include <intrin.h>
+#  define PCLMUL_TARGET
+#else
+#  include <cpuid.h>
+#  define PCLMUL_TARGET __attribute__((target("sse2,pclmul")))
+#endif
+
+local int pclmul_available OF((void));
+local PCLMUL_TARGET z_crc_t crc_pclmul OF((z_crc_t crc,
+                                           const unsigned char FAR *buf,
+                                           z_size_t len));
+
+/*
+  Return true if the processor has PCLMULQDQ (CPUID leaf 1, ECX bit 1). The
+  answer is cached; threads racing on the first call all store the same value.
+ */
+local int pclmul_available()
+{
+    static int volatile available = -1;
+    if (available < 0) {
+        unsigned ecx;
+#ifdef _MSC_VER
+        int regs[4];
+        __cpuid(regs, 1);
+        ecx = (unsigned)regs[2];
+#else
+        unsigned eax, ebx, edx;
+        ecx = 0;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+            ecx = 0;
+#endif
+        available = (ecx >> 1) & 1;
+    }
+    return available;
+}
+
+/*
+  Fold the pre-conditioned crc over len bytes at buf with carry-less
+  multiplies, 64 bytes at a time in four lanes, then down to 128 bits, and
+  finish with a Barrett reduction, after Gopal et al., "Fast CRC Computation
+  for Generic Polynomials Using PCLMULQDQ Instruction" (Intel, 2009). len must
+  be at least 64 and a multiple of 16. The result is still pre-conditioned.
+ */
+local PCLMUL_TARGET z_crc_t crc_pclmul(crc, buf, len)
+    z_crc_t crc;
+    const unsigned char FAR *buf;
+    z_size_t len;
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8, mask;
+
+    /* x^(4*128+32) and x^(4*128-32) mod P, bit-reflected, to fold 512 bits */
+    x0 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    buf += 64;
+    len -= 64;
+
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold the four lanes into one, with the constants for 128 bits. */
+    x0 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* Fold in the remaining 16-byte blocks. */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* Fold 128 bits down to 64. */
+    mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+    x0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits, with P and floor(x^64 / P) reflected. */
+    x0 = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (z_crc_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+#endif /* PCLMULCRC32 */
+
 /* ========================================================================= */
 unsigned long ZEXPORT crc32_z(crc, buf, len)
     unsigned long crc;
@@ -760,6 +909,16 @@ unsigned long ZEXPORT crc32_z(crc, buf, len)
     /* Pre-condition the CRC */
     crc = (~crc) & 0xffffffff;
 
+#ifdef PCLMULCRC32
+    /* Fold all the whole 16-byte blocks, leaving the rest to the code below. */
+    if (len >= 64 && pclmul_available()) {
+        z_size_t blocks = len & ~(z_size_t)15;
+        crc = crc_pclmul((z_crc_t)crc, buf, blocks);
+        buf += blocks;
+        len -= blocks;
+    }
+#endif /* PCLMULCRC32 */
+
 #ifdef W
 
     /* If provided enough bytes, do a braided CRC calculation. */
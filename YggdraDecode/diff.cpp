@@ -0,0 +1,298 @@
+#include "diff.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "archive.h"
+#include "md5.h"
+#include "memstats.h"
+#include "stats.h"
+
+namespace {
+using Digest = std::array<unsigned char, 16>;
+
+struct Side {
+    File* Archive = nullptr;
+    uint64_t DataOffset = 0;
+    std::vector<FileTableEntry> Table;
+    std::unordered_map<std::string, size_t> Paths;
+    std::vector<const std::string*> PathOf; // by table index, files only
+    std::vector<Digest> Digests;            // by table index, for the files that get hashed
+    std::vector<uint8_t> Failed;            // by table index, hashing threw
+};
+
+void Load(Side& side, File& f) {
+    side.Archive = &f;
+    side.DataOffset = ReadFileTable(f, side.Table);
+    MemoryScope scope(MemorySubsystem::PathStrings);
+    for (size_t i = 0; i < side.Table.size(); ++i) {
+        CollectFilePaths(side.Paths, "", side.Table, i);
+    }
+    side.PathOf.resize(side.Table.size());
+    for (const auto& [path, idx] : side.Paths) {
+        side.PathOf[idx] = &path;
+    }
+    side.Digests.resize(side.Table.size());
+    side.Failed.resize(side.Table.size());
+}
+
+size_t StoredSize(const FileTableEntry& e) {
+    return ((e.Length & 0x3fff'ffff) + 3) & ~size_t(3);
+}
+
+// MD5 of a decrypted blob. It's decrypted a chunk at a time, straight out of the mapping if there
+// is one; chunks are a multiple of 16 bytes, which keeps the key in phase.
+Digest HashBlob(const Side& side, const FileTableEntry& e, std::vector<char>& buffer) {
+    const size_t chunkSize = 256 * 1024;
+    buffer.resize(chunkSize);
+    size_t length = StoredSize(e);
+    uint64_t offset = side.DataOffset + e.DataOffset;
+    const char* mapped = side.Archive->MappedData();
+    bool inMapping = mapped && offset + length <= side.Archive->Size();
+
+    md5_state_t md5;
+    md5_init(&md5);
+    for (size_t done = 0; done < length; done += chunkSize) {
+        size_t chunk = std::min(chunkSize, length - done);
+        if (inMapping) {
+            Crypt(buffer.data(), mapped + offset + done, chunk, e.Key, e.Name);
+        } else {
+            {
+                PhaseTimer timer(StatPhase::Read, chunk, e.Name);
+                if (side.Archive->ReadAt(buffer.data(), chunk, offset + done) != chunk) {
+                    throw "blob runs past the end of the archive";
+                }
+            }
+            Crypt(buffer.data(), buffer.data(), chunk, e.Key, e.Name);
+        }
+        PhaseTimer timer(StatPhase::Hash, chunk, e.Name);
+        md5_append(&md5, (const md5_byte_t*)buffer.data(), static_cast<int>(chunk));
+    }
+    Digest digest;
+    md5_finish(&md5, digest.data());
+    return digest;
+}
+
+// The size a file extracts to; compressed blobs start with it.
+uint64_t OriginalSize(const Side& side, size_t idx) {
+    const auto& e = side.Table[idx];
+    if (!(e.Length & 0x4000'0000) || (e.Length & 0x3fff'ffff) < 4) {
+        return e.Length & 0x3fff'ffff;
+    }
+    char prefix[4];
+    if (side.Archive->ReadAt(prefix, 4, side.DataOffset + e.DataOffset) != 4) {
+        return 0;
+    }
+    Crypt(prefix, prefix, 4, e.Key, e.Name);
+    uint32_t size;
+    std::memcpy(&size, prefix, 4);
+    return size;
+}
+
+double Mebibytes(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+} // namespace
+
+ArchiveDiff DiffArchives(File& oldArchive, File& newArchive, size_t threads) {
+    auto start = std::chrono::steady_clock::now();
+    ArchiveDiff diff;
+    Side olds;
+    Side news;
+    Load(olds, oldArchive);
+    Load(news, newArchive);
+
+    // files at the same path are only hashed if their Length matches; otherwise they differ
+    struct Task {
+        Side* Owner;
+        size_t Index;
+    };
+    std::vector<Task> tasks;
+    std::vector<std::pair<size_t, size_t>> common;
+    std::vector<size_t> removed;
+    std::vector<size_t> added;
+    for (const auto& [path, oldIdx] : olds.Paths) {
+        auto it = news.Paths.find(path);
+        if (it == news.Paths.end()) {
+            removed.push_back(oldIdx);
+        } else if (olds.Table[oldIdx].Length != news.Table[it->second].Length) {
+            diff.Modified.push_back(DiffEntry{path, {}, OriginalSize(olds, oldIdx),
+                                              OriginalSize(news, it->second)});
+        } else {
+            common.emplace_back(oldIdx, it->second);
+            tasks.push_back(Task{&olds, oldIdx});
+            tasks.push_back(Task{&news, it->second});
+        }
+    }
+    for (const auto& [path, newIdx] : news.Paths) {
+        if (olds.Paths.find(path) == olds.Paths.end()) {
+            added.push_back(newIdx);
+        }
+    }
+
+    // a renamed file keeps its contents and so its Length; only those with a match on the other
+    // side are worth hashing
+    std::unordered_set<uint32_t> removedLengths;
+    std::unordered_set<uint32_t> addedLengths;
+    for (size_t idx : removed) {
+        removedLengths.insert(olds.Table[idx].Length);
+    }
+    for (size_t idx : added) {
+        addedLengths.insert(news.Table[idx].Length);
+    }
+    for (size_t idx : removed) {
+        if (addedLengths.count(olds.Table[idx].Length)) {
+            tasks.push_back(Task{&olds, idx});
+        }
+    }
+    for (size_t idx : added) {
+        if (removedLengths.count(news.Table[idx].Length)) {
+            tasks.push_back(Task{&news, idx});
+        }
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> hashedBytes{0};
+    std::mutex problemsMutex;
+    const auto work = [&]() {
+        MemoryScope scope(MemorySubsystem::FileBuffers);
+        std::vector<char> buffer;
+        for (size_t k; (k = next.fetch_add(1, std::memory_order_relaxed)) < tasks.size();) {
+            Side& side = *tasks[k].Owner;
+            size_t idx = tasks[k].Index;
+            const auto& e = side.Table[idx];
+            std::string error;
+            try {
+                side.Digests[idx] = HashBlob(side, e, buffer);
+                hashedBytes.fetch_add(StoredSize(e), std::memory_order_relaxed);
+                continue;
+            } catch (const char* message) {
+                error = message;
+            } catch (const std::bad_alloc&) {
+                error = "out of memory hashing it";
+            } catch (const std::exception& exception) {
+                error = exception.what();
+            }
+            side.Failed[idx] = 1;
+            std::lock_guard<std::mutex> lock(problemsMutex);
+            diff.Problems.push_back(*side.PathOf[idx] + ": " + error);
+        }
+    };
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max<size_t>(1, std::min(threads, tasks.size()));
+    {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < threads; ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
+    diff.Threads = threads;
+    diff.HashedBytes = hashedBytes.load();
+
+    std::sort(diff.Problems.begin(), diff.Problems.end());
+    for (const auto& [oldIdx, newIdx] : common) {
+        if (olds.Failed[oldIdx] || news.Failed[newIdx]) {
+            continue;
+        }
+        if (olds.Digests[oldIdx] == news.Digests[newIdx]) {
+            ++diff.Unchanged;
+        } else {
+            diff.Modified.push_back(DiffEntry{*news.PathOf[newIdx], {},
+                                              OriginalSize(olds, oldIdx),
+                                              OriginalSize(news, newIdx)});
+        }
+    }
+
+    // pair added and removed files by Length and digest, in path order so reruns agree
+    const auto byPath = [](const Side& side) {
+        return [&side](size_t lhs, size_t rhs) { return *side.PathOf[lhs] < *side.PathOf[rhs]; };
+    };
+    std::sort(removed.begin(), removed.end(), byPath(olds));
+    std::sort(added.begin(), added.end(), byPath(news));
+    std::multimap<std::pair<uint32_t, Digest>, size_t> gone;
+    for (size_t idx : removed) {
+        if (addedLengths.count(olds.Table[idx].Length) && !olds.Failed[idx]) {
+            gone.emplace(std::make_pair(olds.Table[idx].Length, olds.Digests[idx]), idx);
+        }
+    }
+    std::vector<uint8_t> renamedFrom(olds.Table.size());
+    for (size_t idx : added) {
+        if (news.Failed[idx]) {
+            continue;
+        }
+        uint64_t size = OriginalSize(news, idx);
+        auto it = removedLengths.count(news.Table[idx].Length)
+                      ? gone.find(std::make_pair(news.Table[idx].Length, news.Digests[idx]))
+                      : gone.end();
+        if (it == gone.end()) {
+            diff.Added.push_back(DiffEntry{*news.PathOf[idx], {}, 0, size});
+            continue;
+        }
+        renamedFrom[it->second] = 1;
+        diff.Renamed.push_back(DiffEntry{*news.PathOf[idx], *olds.PathOf[it->second], size, size});
+        gone.erase(it);
+    }
+    for (size_t idx : removed) {
+        if (!renamedFrom[idx] && !olds.Failed[idx]) {
+            diff.Removed.push_back(DiffEntry{*olds.PathOf[idx], {}, OriginalSize(olds, idx), 0});
+        }
+    }
+
+    std::sort(diff.Modified.begin(), diff.Modified.end(),
+              [](const DiffEntry& lhs, const DiffEntry& rhs) { return lhs.Path < rhs.Path; });
+    diff.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return diff;
+}
+
+void PrintArchiveDiff(FILE* out, const ArchiveDiff& diff) {
+    for (const auto& d : diff.Added) {
+        fprintf(out, "A %s (%llu bytes)\n", d.Path.c_str(),
+                static_cast<unsigned long long>(d.NewSize));
+    }
+    for (const auto& d : diff.Removed) {
+        fprintf(out, "D %s (%llu bytes)\n", d.Path.c_str(),
+                static_cast<unsigned long long>(d.OldSize));
+    }
+    for (const auto& d : diff.Renamed) {
+        fprintf(out, "R %s -> %s (%llu bytes)\n", d.OldPath.c_str(), d.Path.c_str(),
+                static_cast<unsigned long long>(d.NewSize));
+    }
+    for (const auto& d : diff.Modified) {
+        long long delta = static_cast<long long>(d.NewSize) - static_cast<long long>(d.OldSize);
+        fprintf(out, "M %s (%llu -> %llu bytes, %+lld)\n", d.Path.c_str(),
+                static_cast<unsigned long long>(d.OldSize),
+                static_cast<unsigned long long>(d.NewSize), delta);
+    }
+    fprintf(out, "%zu added, %zu removed, %zu renamed, %zu modified, %llu unchanged\n",
+            diff.Added.size(), diff.Removed.size(), diff.Renamed.size(), diff.Modified.size(),
+            static_cast<unsigned long long>(diff.Unchanged));
+    for (const auto& problem : diff.Problems) {
+        fprintf(out, "%s\n", problem.c_str());
+    }
+    if (!diff.Problems.empty()) {
+        fprintf(out, "%zu file%s couldn't be compared\n", diff.Problems.size(),
+                diff.Problems.size() == 1 ? "" : "s");
+    }
+    double seconds = std::max(diff.Seconds, 1e-9);
+    fprintf(out, "%.1f MiB hashed in %.3f s on %zu threads, %.1f MiB/s\n",
+            Mebibytes(diff.HashedBytes), diff.Seconds, diff.Threads,
+            Mebibytes(diff.HashedBytes) / seconds);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+// What changed between two archives, worked out from their file tables and the stored blobs
+// without inflating anything. Files are joined by path; files at the same path with the same
+// Length are compared by an MD5 of their decrypted blobs, and so are added and removed files of
+// the same Length, to pair them up as renames. The hashing runs on all cores.
+struct DiffEntry {
+    std::string Path;
+    std::string OldPath; // renames only
+    uint64_t OldSize = 0; // original sizes, read from the size prefix of compressed blobs
+    uint64_t NewSize = 0;
+};
+
+struct ArchiveDiff {
+    std::vector<DiffEntry> Added;
+    std::vector<DiffEntry> Removed;
+    std::vector<DiffEntry> Renamed;
+    std::vector<DiffEntry> Modified;
+    uint64_t Unchanged = 0;
+
+    // files whose blobs couldn't be read, "path: what went wrong"; they're left out of the lists
+    // above
+    std::vector<std::string> Problems;
+
+    uint64_t HashedBytes = 0;
+    size_t Threads = 0;
+    double Seconds = 0.0;
+
+    bool Empty() const {
+        return Added.empty() && Removed.empty() && Renamed.empty() && Modified.empty()
+               && Problems.empty();
+    }
+};
+
+// threads is 0 for one per core.
+ArchiveDiff DiffArchives(File& oldArchive, File& newArchive, size_t threads = 0);
+
+void PrintArchiveDiff(FILE* out, const ArchiveDiff& diff);
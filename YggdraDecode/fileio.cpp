@@ -0,0 +1,470 @@
+#include "fileio.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+bool OpenNativeFileForReading(NativeFile& file, const std::filesystem::path& path) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file = h;
+    return true;
+}
+
+bool OpenNativeFileForWriting(NativeFile& file, const std::filesystem::path& path) {
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    file = h;
+    return true;
+}
+
+void CloseNativeFile(NativeFile file) {
+    CloseHandle(file);
+}
+
+NativeFile GetNativeFile(FILE* f) {
+    return reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(f)));
+}
+
+int64_t NativeReadAt(NativeFile file, void* buffer, size_t length, uint64_t offset) {
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD count = static_cast<DWORD>(std::min<size_t>(length, 0x4000'0000));
+    DWORD read = 0;
+    if (!ReadFile(file, buffer, count, &read, &ov)) {
+        return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+    }
+    return read;
+}
+
+int64_t NativeWriteAt(NativeFile file, const void* buffer, size_t length, uint64_t offset) {
+    OVERLAPPED ov{};
+    ov.Offset = static_cast<DWORD>(offset);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD count = static_cast<DWORD>(std::min<size_t>(length, 0x4000'0000));
+    DWORD written = 0;
+    if (!WriteFile(file, buffer, count, &written, &ov)) {
+        return -1;
+    }
+    return written;
+}
+
+int64_t NativeCopyRange(NativeFile in, uint64_t inOffset, NativeFile out, uint64_t outOffset,
+                        size_t length) {
+    return -1;
+}
+
+bool PreallocateNativeFile(NativeFile file, uint64_t size) {
+    FILE_ALLOCATION_INFO info{};
+    info.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    return !!SetFileInformationByHandle(file, FileAllocationInfo, &info, sizeof(info));
+}
+
+static uint64_t GetNativeFileSize(NativeFile file) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        throw "failed to query file size";
+    }
+    return static_cast<uint64_t>(size.QuadPart);
+}
+
+static bool SeekStdio(FILE* f, uint64_t offset) {
+    return _fseeki64(f, static_cast<__int64>(offset), SEEK_SET) == 0;
+}
+
+static uint64_t TellStdioEnd(FILE* f) {
+    if (_fseeki64(f, 0, SEEK_END) != 0) {
+        throw "failed to query file size";
+    }
+    return static_cast<uint64_t>(_ftelli64(f));
+}
+#else
+bool OpenNativeFileForReading(NativeFile& file, const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    file = fd;
+    return true;
+}
+
+bool OpenNativeFileForWriting(NativeFile& file, const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+    file = fd;
+    return true;
+}
+
+void CloseNativeFile(NativeFile file) {
+    close(file);
+}
+
+NativeFile GetNativeFile(FILE* f) {
+    return fileno(f);
+}
+
+int64_t NativeReadAt(NativeFile file, void* buffer, size_t length, uint64_t offset) {
+    for (;;) {
+        ssize_t rv = pread(file, buffer, length, static_cast<off_t>(offset));
+        if (rv < 0 && errno == EINTR) {
+            continue;
+        }
+        return rv;
+    }
+}
+
+int64_t NativeWriteAt(NativeFile file, const void* buffer, size_t length, uint64_t offset) {
+    for (;;) {
+        ssize_t rv = pwrite(file, buffer, length, static_cast<off_t>(offset));
+        if (rv < 0 && errno == EINTR) {
+            continue;
+        }
+        return rv;
+    }
+}
+
+int64_t NativeCopyRange(NativeFile in, uint64_t inOffset, NativeFile out, uint64_t outOffset,
+                        size_t length) {
+#ifdef __linux__
+    off_t inPos = static_cast<off_t>(inOffset);
+    off_t outPos = static_cast<off_t>(outOffset);
+    for (;;) {
+        ssize_t rv = copy_file_range(in, &inPos, out, &outPos, length, 0);
+        if (rv < 0 && errno == EINTR) {
+            continue;
+        }
+        return rv;
+    }
+#else
+    return -1;
+#endif
+}
+
+bool PreallocateNativeFile(NativeFile file, uint64_t size) {
+#ifdef __linux__
+    return fallocate(file, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0;
+#else
+    return false;
+#endif
+}
+
+static uint64_t GetNativeFileSize(NativeFile file) {
+    struct stat st;
+    if (fstat(file, &st) != 0) {
+        throw "failed to query file size";
+    }
+    return static_cast<uint64_t>(st.st_size);
+}
+
+static bool SeekStdio(FILE* f, uint64_t offset) {
+    return fseeko(f, static_cast<off_t>(offset), SEEK_SET) == 0;
+}
+
+static uint64_t TellStdioEnd(FILE* f) {
+    if (fseeko(f, 0, SEEK_END) != 0) {
+        throw "failed to query file size";
+    }
+    return static_cast<uint64_t>(ftello(f));
+}
+#endif
+
+namespace {
+class StdioFile final : public File {
+public:
+    explicit StdioFile(FILE* f) : F(f) {}
+
+    ~StdioFile() override {
+        fclose(F);
+    }
+
+    uint64_t Size() override {
+        std::lock_guard<std::mutex> lock(Mutex);
+        fflush(F);
+        return TellStdioEnd(F);
+    }
+
+    size_t ReadAt(void* buffer, size_t length, uint64_t offset) override {
+        std::lock_guard<std::mutex> lock(Mutex);
+        if (!SeekStdio(F, offset)) {
+            throw "failed to seek in file";
+        }
+        size_t read = fread(buffer, 1, length, F);
+        if (read != length && ferror(F)) {
+            throw "failed to read file";
+        }
+        return read;
+    }
+
+    void WriteAt(const void* buffer, size_t length, uint64_t offset) override {
+        std::lock_guard<std::mutex> lock(Mutex);
+        if (!SeekStdio(F, offset)) {
+            throw "failed to seek in file";
+        }
+        if (fwrite(buffer, 1, length, F) != length) {
+            throw "failed to write file";
+        }
+    }
+
+    NativeFile Native() const override {
+        return GetNativeFile(F);
+    }
+
+private:
+    FILE* F;
+    std::mutex Mutex;
+};
+
+class PositionalFile final : public File {
+public:
+    explicit PositionalFile(NativeFile h) : H(h) {}
+
+    ~PositionalFile() override {
+        CloseNativeFile(H);
+    }
+
+    uint64_t Size() override {
+        return GetNativeFileSize(H);
+    }
+
+    size_t ReadAt(void* buffer, size_t length, uint64_t offset) override {
+        char* p = static_cast<char*>(buffer);
+        size_t done = 0;
+        while (done < length) {
+            int64_t rv = NativeReadAt(H, p + done, length - done, offset + done);
+            if (rv < 0) {
+                throw "failed to read file";
+            }
+            if (rv == 0) {
+                break;
+            }
+            done += static_cast<size_t>(rv);
+        }
+        return done;
+    }
+
+    void WriteAt(const void* buffer, size_t length, uint64_t offset) override {
+        const char* p = static_cast<const char*>(buffer);
+        size_t done = 0;
+        while (done < length) {
+            int64_t rv = NativeWriteAt(H, p + done, length - done, offset + done);
+            if (rv <= 0) {
+                throw "failed to write file";
+            }
+            done += static_cast<size_t>(rv);
+        }
+    }
+
+    NativeFile Native() const override {
+        return H;
+    }
+
+private:
+    NativeFile H;
+};
+
+class MappedFile final : public File {
+public:
+    // Takes ownership of h on success; returns nullptr if the file can't be mapped.
+    static std::unique_ptr<MappedFile> Map(NativeFile h) {
+        uint64_t length = GetNativeFileSize(h);
+        if (length > static_cast<uint64_t>(SIZE_MAX)) {
+            return nullptr;
+        }
+        std::unique_ptr<MappedFile> file(new MappedFile(h, length));
+        if (length == 0) {
+            return file;
+        }
+#ifdef _WIN32
+        file->Mapping = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (file->Mapping) {
+            file->Data =
+                static_cast<const char*>(MapViewOfFile(file->Mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+#else
+        void* p = mmap(nullptr, static_cast<size_t>(length), PROT_READ, MAP_SHARED, h, 0);
+        if (p != MAP_FAILED) {
+            file->Data = static_cast<const char*>(p);
+        }
+#endif
+        if (!file->Data) {
+            file->Owned = false;
+            return nullptr;
+        }
+        return file;
+    }
+
+    ~MappedFile() override {
+#ifdef _WIN32
+        if (Data) {
+            UnmapViewOfFile(Data);
+        }
+        if (Mapping) {
+            CloseHandle(Mapping);
+        }
+#else
+        if (Data) {
+            munmap(const_cast<char*>(Data), static_cast<size_t>(Length));
+        }
+#endif
+        if (Owned) {
+            CloseNativeFile(H);
+        }
+    }
+
+    uint64_t Size() override {
+        return Length;
+    }
+
+    size_t ReadAt(void* buffer, size_t length, uint64_t offset) override {
+        if (offset >= Length) {
+            return 0;
+        }
+        size_t count = static_cast<size_t>(std::min<uint64_t>(length, Length - offset));
+        std::memcpy(buffer, Data + offset, count);
+        return count;
+    }
+
+    void WriteAt(const void* /*buffer*/, size_t /*length*/, uint64_t /*offset*/) override {
+        throw "mapped file is read-only";
+    }
+
+    const char* MappedData() const override {
+        return Data;
+    }
+
+    NativeFile Native() const override {
+        return H;
+    }
+
+private:
+    MappedFile(NativeFile h, uint64_t length) : H(h), Length(length) {}
+
+    NativeFile H;
+    uint64_t Length;
+    const char* Data = nullptr;
+    bool Owned = true;
+#ifdef _WIN32
+    HANDLE Mapping = nullptr;
+#endif
+};
+
+class StreamFile final : public File {
+public:
+    explicit StreamFile(FILE* f) : F(f) {}
+
+    ~StreamFile() override {
+        if (F != stdin) {
+            fclose(F);
+        }
+    }
+
+    uint64_t Size() override {
+        return 0;
+    }
+
+    size_t ReadAt(void* buffer, size_t length, uint64_t offset) override {
+        std::lock_guard<std::mutex> lock(Mutex);
+        if (offset < Position) {
+            throw "archive stream would have to seek backwards";
+        }
+        if (offset > Position) {
+            std::vector<char> scratch;
+            scratch.resize(static_cast<size_t>(std::min<uint64_t>(offset - Position, 64 * 1024)));
+            while (Position < offset) {
+                size_t count =
+                    static_cast<size_t>(std::min<uint64_t>(offset - Position, scratch.size()));
+                size_t read = fread(scratch.data(), 1, count, F);
+                if (read == 0) {
+                    return 0;
+                }
+                Position += read;
+            }
+        }
+        size_t read = fread(buffer, 1, length, F);
+        if (read != length && ferror(F)) {
+            throw "failed to read stream";
+        }
+        Position += read;
+        return read;
+    }
+
+    void WriteAt(const void* /*buffer*/, size_t /*length*/, uint64_t /*offset*/) override {
+        throw "stream is read-only";
+    }
+
+    bool IsSeekable() const override {
+        return false;
+    }
+
+    NativeFile Native() const override {
+        return GetNativeFile(F);
+    }
+
+private:
+    FILE* F;
+    uint64_t Position = 0;
+    std::mutex Mutex;
+};
+} // namespace
+
+std::unique_ptr<File> OpenFile(const std::filesystem::path& path, FileMode mode,
+                               FileBackend backend) {
+    if (backend == FileBackend::Stdio) {
+#ifdef _WIN32
+        FILE* f = _wfopen(path.c_str(), mode == FileMode::Read ? L"rb" : L"w+b");
+#else
+        FILE* f = fopen(path.c_str(), mode == FileMode::Read ? "rb" : "w+b");
+#endif
+        if (!f) {
+            return nullptr;
+        }
+        return std::make_unique<StdioFile>(f);
+    }
+
+    NativeFile h;
+    bool opened = mode == FileMode::Read ? OpenNativeFileForReading(h, path)
+                                         : OpenNativeFileForWriting(h, path);
+    if (!opened) {
+        return nullptr;
+    }
+    if (backend == FileBackend::Mmap && mode == FileMode::Read) {
+        if (auto mapped = MappedFile::Map(h)) {
+            return mapped;
+        }
+    }
+    return std::make_unique<PositionalFile>(h);
+}
+
+std::unique_ptr<File> OpenStream(FILE* f) {
+#ifdef _WIN32
+    if (f == stdin) {
+        _setmode(_fileno(stdin), _O_BINARY);
+    }
+#endif
+    return std::make_unique<StreamFile>(f);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+
+#ifdef _WIN32
+using NativeFile = void*; // HANDLE
+#else
+using NativeFile = int;   // file descriptor
+#endif
+
+// Opens a file for positioned reads or writes. Returns false if the file can't be opened.
+bool OpenNativeFileForReading(NativeFile& file, const std::filesystem::path& path);
+bool OpenNativeFileForWriting(NativeFile& file, const std::filesystem::path& path);
+void CloseNativeFile(NativeFile file);
+
+// A single positioned read or write, which may transfer less than asked for. Returns the number
+// of bytes transferred, 0 at the end of the file, or -1 on error. Doesn't move the file position.
+int64_t NativeReadAt(NativeFile file, void* buffer, size_t length, uint64_t offset);
+int64_t NativeWriteAt(NativeFile file, const void* buffer, size_t length, uint64_t offset);
+
+// Copies up to length bytes from one file to another inside the kernel, which may share the
+// blocks instead of copying them. Returns the number of bytes copied, 0 at the end of the input,
+// or -1 if the files or the platform don't support it; the caller then copies through a buffer.
+int64_t NativeCopyRange(NativeFile in, uint64_t inOffset, NativeFile out, uint64_t outOffset,
+                        size_t length);
+
+// Reserves disk space for the first size bytes of the file without changing its length, so the
+// filesystem can lay it out contiguously. Returns false where that isn't supported.
+bool PreallocateNativeFile(NativeFile file, uint64_t size);
+
+// The handle underlying a stdio stream. Positioned I/O on it ignores and doesn't move the
+// stream's own position.
+NativeFile GetNativeFile(FILE* f);
+
+enum class FileMode {
+    Read,
+    Write, // creates the file, or truncates it if it exists
+};
+
+enum class FileBackend {
+    Stdio,      // FILE* with seek + read/write, serialized by a lock
+    Positional, // pread/pwrite, or ReadFile/WriteFile with an offset on Windows
+    Mmap,       // reads from a read-only mapping; writes fall back to Positional
+};
+
+// A file accessed through absolute offsets, so one File can serve concurrent readers.
+// I/O errors are thrown.
+class File {
+public:
+    virtual ~File() = default;
+
+    virtual uint64_t Size() = 0;
+
+    // Reads until length bytes have been read or the file ends; returns the bytes read.
+    virtual size_t ReadAt(void* buffer, size_t length, uint64_t offset) = 0;
+    virtual void WriteAt(const void* buffer, size_t length, uint64_t offset) = 0;
+
+    // Best effort, see PreallocateNativeFile().
+    virtual void Preallocate(uint64_t size) {
+        PreallocateNativeFile(Native(), size);
+    }
+
+    // Streams only support reads at or after the end of the previous read.
+    virtual bool IsSeekable() const {
+        return true;
+    }
+
+    // The whole file when it's memory mapped, nullptr otherwise.
+    virtual const char* MappedData() const {
+        return nullptr;
+    }
+
+    // The OS handle, for handing the file to an IoBackend.
+    virtual NativeFile Native() const = 0;
+};
+
+// Returns nullptr if the file can't be opened.
+std::unique_ptr<File> OpenFile(const std::filesystem::path& path, FileMode mode,
+                               FileBackend backend);
+
+// Wraps a stream that can only be read front to back, like stdin or a pipe. Skipped bytes are
+// read and discarded, and reading before an earlier read throws. Size() is unknown and returns 0.
+// The stream is closed with the File unless it's stdin.
+std::unique_ptr<File> OpenStream(FILE* f);
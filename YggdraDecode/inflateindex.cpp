@@ -0,0 +1,378 @@
+#include "inflateindex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "archive.h"
+#include "memstats.h"
+#include "stats.h"
+#include "zlib.h"
+
+namespace {
+constexpr char Magic[8] = {'Y', 'G', 'G', 'I', 'N', 'D', 'E', 'X'};
+constexpr uint32_t Version = 1;
+
+// stored bytes are read and decrypted this many at a time; a multiple of 16 keeps the key in phase
+constexpr size_t ChunkSize = 256 * 1024;
+
+size_t StoredSize(const FileTableEntry& e) {
+    return ((e.Length & 0x3fff'ffff) + 3) & ~size_t(3);
+}
+
+// Ends the inflate stream however the function using it is left.
+struct InflateStream {
+    z_stream Zs{};
+
+    InflateStream() {
+        Zs.zalloc = ZlibAlloc;
+        Zs.zfree = ZlibFree;
+    }
+    ~InflateStream() { inflateEnd(&Zs); }
+
+    InflateStream(const InflateStream&) = delete;
+    InflateStream& operator=(const InflateStream&) = delete;
+};
+
+// A blob's stored bytes, decrypted, either read from the archive a chunk at a time or already in
+// memory.
+class DecryptedBlob {
+public:
+    DecryptedBlob(File& archive, uint64_t offset, const FileTableEntry& e)
+        : Archive(&archive), Offset(offset), Size(StoredSize(e)), Entry(e) {}
+    DecryptedBlob(const char* data, const FileTableEntry& e)
+        : Data(data), Size(StoredSize(e)), Entry(e) {}
+
+    // The bytes from position on, at least one unless position is at the end.
+    std::string_view From(uint64_t position) {
+        if (position >= Size) {
+            return {};
+        }
+        if (Data) {
+            return std::string_view(Data + position, static_cast<size_t>(Size - position));
+        }
+        uint64_t start = position & ~uint64_t(15);
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(ChunkSize, Size - start));
+        Buffer.resize(chunk);
+        {
+            PhaseTimer timer(StatPhase::Read, chunk, Entry.Name);
+            if (Archive->ReadAt(Buffer.data(), chunk, Offset + start) != chunk) {
+                throw "blob runs past the end of the archive";
+            }
+        }
+        Crypt(Buffer.data(), Buffer.data(), chunk, Entry.Key, Entry.Name);
+        size_t skip = static_cast<size_t>(position - start);
+        return std::string_view(Buffer.data() + skip, chunk - skip);
+    }
+
+private:
+    File* Archive = nullptr;
+    uint64_t Offset = 0;
+    const char* Data = nullptr;
+    uint64_t Size = 0;
+    const FileTableEntry& Entry;
+    std::vector<char> Buffer;
+};
+
+// Inflates from a point, drops the first skip bytes and writes up to length bytes to out.
+size_t InflateFrom(DecryptedBlob& blob, const InflatePoint& point, uint64_t skip, char* out,
+                   size_t length, std::string_view filename) {
+    PhaseTimer timer(StatPhase::Decompress, length, filename);
+    InflateStream stream;
+    z_stream& zs = stream.Zs;
+    if (inflateInit2(&zs, -15) != Z_OK) {
+        throw "failed to initialize inflate";
+    }
+
+    // the stream starts after the size prefix, and a point may start inside a byte
+    uint64_t position = 4 + point.In - (point.Bits ? 1 : 0);
+    std::string_view in = blob.From(position);
+    if (point.Bits) {
+        if (in.empty()) {
+            throw "truncated zlib stream";
+        }
+        int byte = static_cast<unsigned char>(in[0]);
+        in.remove_prefix(1);
+        ++position;
+        inflatePrime(&zs, point.Bits, byte >> (8 - point.Bits));
+    }
+    inflateSetDictionary(&zs, point.Window.data(), static_cast<uInt>(point.Window.size()));
+
+    std::vector<char> discard(static_cast<size_t>(std::min<uint64_t>(skip, InflateWindowSize)));
+    size_t produced = 0;
+    while (skip > 0 || produced < length) {
+        if (zs.avail_in == 0) {
+            if (in.empty()) {
+                in = blob.From(position);
+                if (in.empty()) {
+                    throw "truncated zlib stream";
+                }
+            }
+            zs.next_in = (Bytef*)in.data();
+            zs.avail_in = static_cast<uInt>(in.size());
+            position += in.size();
+            in = {};
+        }
+        uInt available;
+        if (skip > 0) {
+            available = static_cast<uInt>(std::min<uint64_t>(skip, discard.size()));
+            zs.next_out = (Bytef*)discard.data();
+        } else {
+            available = static_cast<uInt>(length - produced);
+            zs.next_out = (Bytef*)out + produced;
+        }
+        zs.avail_out = available;
+        int rv = inflate(&zs, Z_NO_FLUSH);
+        size_t got = available - zs.avail_out;
+        if (skip > 0) {
+            skip -= got;
+        } else {
+            produced += got;
+        }
+        if (rv == Z_STREAM_END) {
+            break;
+        }
+        if (rv != Z_OK && rv != Z_BUF_ERROR) {
+            throw zs.msg ? zs.msg : "damaged zlib stream";
+        }
+    }
+    return produced;
+}
+
+// The last point at or before offset; there's always one at 0.
+const InflatePoint& PointBefore(const std::vector<InflatePoint>& points, uint64_t offset) {
+    auto it = std::upper_bound(
+        points.begin(), points.end(), offset,
+        [](uint64_t value, const InflatePoint& point) { return value < point.Out; });
+    if (it == points.begin()) {
+        throw "inflate index has no point at the start of the file";
+    }
+    return *(it - 1);
+}
+
+class IndexReader {
+public:
+    explicit IndexReader(const std::vector<char>& data) : Data(data) {}
+
+    bool Read(void* buffer, size_t length) {
+        if (Data.size() - Position < length) {
+            return false;
+        }
+        std::memcpy(buffer, Data.data() + Position, length);
+        Position += length;
+        return true;
+    }
+
+    template <typename T>
+    bool Value(T& value) {
+        return Read(&value, sizeof(value));
+    }
+
+private:
+    const std::vector<char>& Data;
+    size_t Position = 0;
+};
+} // namespace
+
+std::vector<InflatePoint> BuildInflatePoints(const char* stream, size_t size, uint64_t span) {
+    PhaseTimer timer(StatPhase::Decompress, 0);
+    InflateStream inflater;
+    z_stream& zs = inflater.Zs;
+    if (inflateInit(&zs) != Z_OK) {
+        throw "failed to initialize inflate";
+    }
+
+    // output goes round a window-sized buffer, which then holds the window at each point
+    std::vector<unsigned char> window(InflateWindowSize);
+    std::vector<InflatePoint> points;
+    zs.next_in = (Bytef*)stream;
+    zs.avail_in = static_cast<uInt>(size);
+    uint64_t totalIn = 0;
+    uint64_t totalOut = 0;
+    uint64_t last = 0;
+    while (true) {
+        if (zs.avail_out == 0) {
+            zs.next_out = window.data();
+            zs.avail_out = static_cast<uInt>(window.size());
+        }
+        totalIn += zs.avail_in;
+        totalOut += zs.avail_out;
+        int rv = inflate(&zs, Z_BLOCK);
+        totalIn -= zs.avail_in;
+        totalOut -= zs.avail_out;
+        if (rv == Z_STREAM_END) {
+            break;
+        }
+        if (rv == Z_BUF_ERROR) {
+            throw "truncated zlib stream";
+        }
+        if (rv != Z_OK) {
+            throw zs.msg ? zs.msg : "damaged zlib stream";
+        }
+
+        // at the end of a block header, but not after the last block
+        if ((zs.data_type & 128) && !(zs.data_type & 64)
+            && (totalOut == 0 || totalOut - last > span)) {
+            auto& point = points.emplace_back();
+            point.Out = totalOut;
+            point.In = totalIn;
+            point.Bits = zs.data_type & 7;
+            point.Window.resize(window.size());
+            size_t left = zs.avail_out;
+            std::memcpy(point.Window.data(), window.data() + window.size() - left, left);
+            std::memcpy(point.Window.data() + left, window.data(), window.size() - left);
+            last = totalOut;
+        }
+    }
+    timer.SetBytes(totalOut);
+    return points;
+}
+
+bool ReadInflateIndex(const std::filesystem::path& path, InflateIndex& index) {
+    index.Blobs.clear();
+    auto f = OpenFile(path, FileMode::Read, FileBackend::Positional);
+    if (!f) {
+        return false;
+    }
+    std::vector<char> data(static_cast<size_t>(f->Size()));
+    data.resize(f->ReadAt(data.data(), data.size(), 0));
+
+    IndexReader reader(data);
+    char magic[sizeof(Magic)];
+    uint32_t version;
+    std::array<unsigned char, 16> archive;
+    uint64_t span;
+    uint32_t count;
+    if (!reader.Read(magic, sizeof(magic)) || std::memcmp(magic, Magic, sizeof(Magic)) != 0
+        || !reader.Value(version) || version != Version
+        || !reader.Read(archive.data(), archive.size()) || archive != index.Archive
+        || !reader.Value(span) || span == 0 || !reader.Value(count)) {
+        return false;
+    }
+
+    std::vector<IndexedBlob> blobs(count);
+    for (auto& blob : blobs) {
+        uint32_t points;
+        if (!reader.Value(blob.DataOffset) || !reader.Value(blob.Length) || !reader.Value(points)
+            || points == 0 || points > data.size() / InflateWindowSize) {
+            return false;
+        }
+        blob.Points.resize(points);
+        for (auto& point : blob.Points) {
+            uint8_t bits;
+            point.Window.resize(InflateWindowSize);
+            if (!reader.Value(point.Out) || !reader.Value(point.In) || !reader.Value(bits)
+                || bits > 7 || !reader.Read(point.Window.data(), point.Window.size())) {
+                return false;
+            }
+            point.Bits = bits;
+        }
+        if (blob.Points.front().Out != 0) {
+            return false;
+        }
+    }
+    index.Span = span;
+    index.Blobs = std::move(blobs);
+    return true;
+}
+
+bool WriteInflateIndex(const std::filesystem::path& path, const InflateIndex& index) {
+    std::vector<char> data;
+    const auto put = [&data](const void* value, size_t size) {
+        data.insert(data.end(), (const char*)value, (const char*)value + size);
+    };
+    uint32_t version = Version;
+    uint32_t count = static_cast<uint32_t>(index.Blobs.size());
+    put(Magic, sizeof(Magic));
+    put(&version, 4);
+    put(index.Archive.data(), index.Archive.size());
+    put(&index.Span, 8);
+    put(&count, 4);
+
+    // in data order, so that rewriting an index doesn't shuffle it
+    std::vector<const IndexedBlob*> blobs;
+    for (const auto& blob : index.Blobs) {
+        blobs.push_back(&blob);
+    }
+    std::sort(blobs.begin(), blobs.end(), [](const IndexedBlob* lhs, const IndexedBlob* rhs) {
+        return lhs->DataOffset < rhs->DataOffset;
+    });
+    for (const auto* blob : blobs) {
+        uint32_t points = static_cast<uint32_t>(blob->Points.size());
+        put(&blob->DataOffset, 4);
+        put(&blob->Length, 4);
+        put(&points, 4);
+        for (const auto& point : blob->Points) {
+            uint8_t bits = static_cast<uint8_t>(point.Bits);
+            put(&point.Out, 8);
+            put(&point.In, 8);
+            put(&bits, 1);
+            put(point.Window.data(), point.Window.size());
+        }
+    }
+
+    auto f = OpenFile(path, FileMode::Write, FileBackend::Positional);
+    if (!f) {
+        return false;
+    }
+    f->WriteAt(data.data(), data.size(), 0); // throws on failure
+    return true;
+}
+
+size_t ReadEntryRange(File& archive, uint64_t dataOffset, const FileTableEntry& e,
+                      const std::vector<InflatePoint>* points, uint64_t span, uint64_t offset,
+                      char* buffer, size_t length, std::vector<InflatePoint>* madePoints) {
+    if (e.Length & 0x8000'0000) {
+        throw "not a file";
+    }
+    if (!(e.Length & 0x4000'0000)) {
+        return ReadRange(archive, dataOffset, e, offset, buffer, length);
+    }
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    uint64_t blobOffset = dataOffset + e.DataOffset;
+    size_t size = e.Length & 0x3fff'ffff;
+    if (size < 4) {
+        throw "compressed blob shorter than its size prefix";
+    }
+    if (points && !points->empty()) {
+        char prefix[4];
+        if (archive.ReadAt(prefix, 4, blobOffset) != 4) {
+            throw "blob runs past the end of the archive";
+        }
+        Crypt(prefix, prefix, 4, e.Key, e.Name);
+        uint32_t decompSize;
+        std::memcpy(&decompSize, prefix, 4);
+        if (offset >= decompSize) {
+            return 0;
+        }
+        length = static_cast<size_t>(std::min<uint64_t>(length, decompSize - offset));
+        DecryptedBlob blob(archive, blobOffset, e);
+        const InflatePoint& point = PointBefore(*points, offset);
+        return InflateFrom(blob, point, offset - point.Out, buffer, length, e.Name);
+    }
+
+    // without points the whole blob is needed, once anyway to make them
+    std::vector<char> data(StoredSize(e));
+    {
+        PhaseTimer timer(StatPhase::Read, data.size(), e.Name);
+        if (archive.ReadAt(data.data(), data.size(), blobOffset) != data.size()) {
+            throw "blob runs past the end of the archive";
+        }
+    }
+    Crypt(data.data(), data.data(), data.size(), e.Key, e.Name);
+    uint32_t decompSize;
+    std::memcpy(&decompSize, data.data(), 4);
+    if (offset >= decompSize) {
+        return 0;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, decompSize - offset));
+    if (!madePoints || decompSize <= span) {
+        std::vector<char> decompressed = DecompressChecked(data.data(), size, e.Name);
+        std::memcpy(buffer, decompressed.data() + offset, length);
+        return length;
+    }
+    *madePoints = BuildInflatePoints(data.data() + 4, size - 4, span);
+    DecryptedBlob blob(data.data(), e);
+    const InflatePoint& point = PointBefore(*madePoints, offset);
+    return InflateFrom(blob, point, offset - point.Out, buffer, length, e.Name);
+}
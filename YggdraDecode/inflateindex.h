@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+struct FileTableEntry;
+
+// Access points into compressed blobs, so that a slice of a big file can be read without inflating
+// everything before it, as in zlib's examples/zran.c. A point records where a deflate block
+// starts, in output bytes and in input bits, and the 32 KiB of output before it, which is all
+// inflate needs to carry on from there.
+//
+// Points live in a sidecar next to the archive, <archive>.idx, written by PackArchive with
+// PackOptions::IndexSpan or filled in by ArchiveReader as files are first read. The sidecar
+// holds the MD5 of the archive's header and InfoData and is ignored when that doesn't match.
+constexpr size_t InflateWindowSize = 32 * 1024;
+
+struct InflatePoint {
+    uint64_t Out = 0; // offset in the inflated file
+    uint64_t In = 0;  // offset in the zlib stream of the first byte that is wholly after the point
+    int Bits = 0;     // bits of the byte before In that belong after the point, 0 to 7
+    std::vector<unsigned char> Window; // the InflateWindowSize bytes of output before Out
+};
+
+struct IndexedBlob {
+    uint32_t DataOffset = 0; // identifies the blob, together with
+    uint32_t Length = 0;     // the file table's Length, flags and all
+    std::vector<InflatePoint> Points;
+};
+
+struct InflateIndex {
+    std::array<unsigned char, 16> Archive{}; // see HashArchivePrefix()
+    uint64_t Span = 1024 * 1024;             // output bytes between points
+    std::vector<IndexedBlob> Blobs;
+};
+
+// Inflates a zlib stream (a blob without its size prefix) once and records a point at most
+// every span output bytes. Throws if the stream is damaged.
+std::vector<InflatePoint> BuildInflatePoints(const char* stream, size_t size, uint64_t span);
+
+// false if there's no index at path or it belongs to another archive; the caller then starts
+// an empty one.
+bool ReadInflateIndex(const std::filesystem::path& path, InflateIndex& index);
+bool WriteInflateIndex(const std::filesystem::path& path, const InflateIndex& index);
+
+// Reads up to length bytes at offset of a file's contents and returns how many there were.
+// Stored files go through ReadRange(). Compressed files are inflated from the closest of points
+// before offset; without points, they're inflated in full. If madePoints isn't null and the file
+// is bigger than span, its points are made along the way and handed back there, for the caller to
+// keep. Doesn't touch any shared state, so reads may run on several threads at once.
+size_t ReadEntryRange(File& archive, uint64_t dataOffset, const FileTableEntry& e,
+                      const std::vector<InflatePoint>* points, uint64_t span, uint64_t offset,
+                      char* buffer, size_t length, std::vector<InflatePoint>* madePoints);
@@ -0,0 +1,399 @@
+#include "iobackend.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define YGGDRA_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace {
+struct IoRequest {
+    bool IsWrite = false;
+    NativeFile File;
+    char* Buffer = nullptr;
+    size_t Length = 0;
+    uint64_t Offset = 0;
+    size_t Transferred = 0;
+    IoBackend::Callback Done;
+#ifdef YGGDRA_HAS_IO_URING
+    iovec Iov{};
+#endif
+};
+
+class ThreadPoolIoBackend final : public IoBackend {
+public:
+    explicit ThreadPoolIoBackend(size_t threadCount) {
+        for (size_t i = 0; i < threadCount; ++i) {
+            Workers.emplace_back([this] { Run(); });
+        }
+    }
+
+    ~ThreadPoolIoBackend() override {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Stopping = true;
+        }
+        WorkAvailable.notify_all();
+        for (auto& t : Workers) {
+            t.join();
+        }
+    }
+
+    void SubmitRead(NativeFile file, char* buffer, size_t length, uint64_t offset,
+                    Callback done) override {
+        Enqueue(IoRequest{false, file, buffer, length, offset, 0, std::move(done)});
+    }
+
+    void SubmitWrite(NativeFile file, const char* buffer, size_t length, uint64_t offset,
+                     Callback done) override {
+        Enqueue(IoRequest{true, file, const_cast<char*>(buffer), length, offset, 0,
+                          std::move(done)});
+    }
+
+    void Drain() override {
+        std::unique_lock<std::mutex> lock(Mutex);
+        Idle.wait(lock, [this] { return Outstanding == 0; });
+        if (Error) {
+            auto e = Error;
+            Error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    const char* Name() const override {
+        return "threads";
+    }
+
+private:
+    void Enqueue(IoRequest request) {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Queue.push_back(std::move(request));
+            ++Outstanding;
+        }
+        WorkAvailable.notify_one();
+    }
+
+    static int64_t Transfer(IoRequest& r) {
+        while (r.Transferred < r.Length) {
+            char* p = r.Buffer + r.Transferred;
+            size_t count = r.Length - r.Transferred;
+            uint64_t offset = r.Offset + r.Transferred;
+            int64_t rv = r.IsWrite ? NativeWriteAt(r.File, p, count, offset)
+                                   : NativeReadAt(r.File, p, count, offset);
+            if (rv <= 0) {
+                return -1;
+            }
+            r.Transferred += static_cast<size_t>(rv);
+        }
+        return static_cast<int64_t>(r.Length);
+    }
+
+    void Run() {
+        for (;;) {
+            IoRequest r;
+            {
+                std::unique_lock<std::mutex> lock(Mutex);
+                WorkAvailable.wait(lock, [this] { return Stopping || !Queue.empty(); });
+                if (Queue.empty()) {
+                    return;
+                }
+                r = std::move(Queue.front());
+                Queue.pop_front();
+            }
+
+            int64_t result = Transfer(r);
+            std::exception_ptr error;
+            try {
+                r.Done(result);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(Mutex);
+            if (error && !Error) {
+                Error = error;
+            }
+            if (--Outstanding == 0) {
+                Idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> Workers;
+    std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    std::condition_variable Idle;
+    std::deque<IoRequest> Queue;
+    size_t Outstanding = 0;
+    bool Stopping = false;
+    std::exception_ptr Error;
+};
+
+#ifdef YGGDRA_HAS_IO_URING
+// io_uring driven through the raw syscalls, so liburing isn't needed. Completions, and with them
+// the callbacks, are processed on the thread calling Drain().
+class IoUringBackend final : public IoBackend {
+public:
+    static std::unique_ptr<IoUringBackend> Create(unsigned entries) {
+        std::unique_ptr<IoUringBackend> backend(new IoUringBackend());
+        if (!backend->Setup(entries)) {
+            return nullptr;
+        }
+        return backend;
+    }
+
+    ~IoUringBackend() override {
+        if (Sqes != MAP_FAILED) {
+            munmap(Sqes, SqesSize);
+        }
+        if (CqRing != MAP_FAILED && CqRing != SqRing) {
+            munmap(CqRing, CqRingSize);
+        }
+        if (SqRing != MAP_FAILED) {
+            munmap(SqRing, SqRingSize);
+        }
+        if (RingFd >= 0) {
+            close(RingFd);
+        }
+    }
+
+    void SubmitRead(NativeFile file, char* buffer, size_t length, uint64_t offset,
+                    Callback done) override {
+        Pending.emplace_back(
+            new IoRequest{false, file, buffer, length, offset, 0, std::move(done), {}});
+    }
+
+    void SubmitWrite(NativeFile file, const char* buffer, size_t length, uint64_t offset,
+                     Callback done) override {
+        Pending.emplace_back(new IoRequest{true, file, const_cast<char*>(buffer), length, offset,
+                                           0, std::move(done), {}});
+    }
+
+    void Drain() override {
+        while (!Pending.empty() || InFlight > 0) {
+            FillSubmissionQueue();
+            unsigned minComplete = InFlight > Unsubmitted ? 1 : 0;
+            long rv = syscall(__NR_io_uring_enter, RingFd, Unsubmitted, minComplete,
+                              IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (rv < 0) {
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    Abandon();
+                    throw "io_uring_enter failed";
+                }
+            } else {
+                Unsubmitted -= static_cast<unsigned>(rv);
+            }
+            ReapCompletions();
+        }
+        if (Error) {
+            auto e = Error;
+            Error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    const char* Name() const override {
+        return "io_uring";
+    }
+
+private:
+    IoUringBackend() = default;
+
+    bool Setup(unsigned entries) {
+        io_uring_params p{};
+        RingFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if (RingFd < 0) {
+            return false;
+        }
+
+        SqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        CqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = !!(p.features & IORING_FEAT_SINGLE_MMAP);
+        if (singleMmap) {
+            SqRingSize = CqRingSize = std::max(SqRingSize, CqRingSize);
+        }
+        SqRing = mmap(nullptr, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      RingFd, IORING_OFF_SQ_RING);
+        if (SqRing == MAP_FAILED) {
+            return false;
+        }
+        if (singleMmap) {
+            CqRing = SqRing;
+        } else {
+            CqRing = mmap(nullptr, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          RingFd, IORING_OFF_CQ_RING);
+            if (CqRing == MAP_FAILED) {
+                return false;
+            }
+        }
+        SqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        Sqes = mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, RingFd,
+                    IORING_OFF_SQES);
+        if (Sqes == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(SqRing);
+        SqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        SqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        SqMask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        SqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        char* cq = static_cast<char*>(CqRing);
+        CqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        CqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        CqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        Cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        Entries = p.sq_entries;
+        return true;
+    }
+
+    // Moves pending requests into the submission ring, keeping at most Entries in flight so the
+    // completion ring (twice as large) can't overflow.
+    void FillSubmissionQueue() {
+        unsigned tail = *SqTail;
+        while (!Pending.empty() && InFlight < Entries) {
+            IoRequest* r = Pending.front().release();
+            Pending.pop_front();
+
+            r->Iov.iov_base = r->Buffer + r->Transferred;
+            r->Iov.iov_len = r->Length - r->Transferred;
+            unsigned index = tail & SqMask;
+            io_uring_sqe& sqe = static_cast<io_uring_sqe*>(Sqes)[index];
+            sqe = io_uring_sqe{};
+            sqe.opcode = r->IsWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+            sqe.fd = r->File;
+            sqe.off = r->Offset + r->Transferred;
+            sqe.addr = reinterpret_cast<uint64_t>(&r->Iov);
+            sqe.len = 1;
+            sqe.user_data = reinterpret_cast<uint64_t>(r);
+            SqArray[index] = index;
+            ++tail;
+            ++InFlight;
+            ++Unsubmitted;
+        }
+        __atomic_store_n(SqTail, tail, __ATOMIC_RELEASE);
+    }
+
+    // After a failed io_uring_enter: takes back what the kernel hasn't picked up yet, waits for
+    // the rest to complete, since the callers' buffers must outlive it, and fails whatever is
+    // left without submitting it.
+    void Abandon() {
+        unsigned head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+        unsigned tail = *SqTail;
+        while (tail != head) {
+            --tail;
+            const io_uring_sqe& sqe = static_cast<io_uring_sqe*>(Sqes)[SqArray[tail & SqMask]];
+            Pending.emplace_front(reinterpret_cast<IoRequest*>(sqe.user_data));
+            --InFlight;
+        }
+        __atomic_store_n(SqTail, tail, __ATOMIC_RELEASE);
+        Unsubmitted = 0;
+
+        while (InFlight > 0) {
+            long rv = syscall(__NR_io_uring_enter, RingFd, 0, InFlight, IORING_ENTER_GETEVENTS,
+                              nullptr, 0);
+            if (rv < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                break; // the ring itself is broken; there is nothing left to wait with
+            }
+            ReapCompletions();
+        }
+
+        while (!Pending.empty()) {
+            std::unique_ptr<IoRequest> r = std::move(Pending.front());
+            Pending.pop_front();
+            try {
+                r->Done(-1);
+            } catch (...) {
+                // the io_uring_enter failure is what gets reported
+            }
+        }
+        Error = nullptr;
+    }
+
+    void ReapCompletions() {
+        unsigned head = *CqHead;
+        while (head != __atomic_load_n(CqTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& cqe = Cqes[head & CqMask];
+            std::unique_ptr<IoRequest> r(reinterpret_cast<IoRequest*>(cqe.user_data));
+            int res = cqe.res;
+            ++head;
+            __atomic_store_n(CqHead, head, __ATOMIC_RELEASE);
+            --InFlight;
+
+            if (res == -EINTR || res == -EAGAIN) {
+                Pending.push_front(std::move(r));
+                continue;
+            }
+            if (res > 0) {
+                r->Transferred += static_cast<size_t>(res);
+            }
+            bool complete = r->Transferred == r->Length;
+            if (!complete && res > 0) {
+                Pending.push_front(std::move(r));
+                continue;
+            }
+
+            int64_t result = complete ? static_cast<int64_t>(r->Length) : -1;
+            try {
+                r->Done(result);
+            } catch (...) {
+                if (!Error) {
+                    Error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    int RingFd = -1;
+    void* SqRing = MAP_FAILED;
+    void* CqRing = MAP_FAILED;
+    void* Sqes = MAP_FAILED;
+    size_t SqRingSize = 0;
+    size_t CqRingSize = 0;
+    size_t SqesSize = 0;
+    unsigned* SqHead = nullptr;
+    unsigned* SqTail = nullptr;
+    unsigned SqMask = 0;
+    unsigned* SqArray = nullptr;
+    unsigned* CqHead = nullptr;
+    unsigned* CqTail = nullptr;
+    unsigned CqMask = 0;
+    io_uring_cqe* Cqes = nullptr;
+    unsigned Entries = 0;
+
+    std::deque<std::unique_ptr<IoRequest>> Pending;
+    unsigned InFlight = 0;
+    unsigned Unsubmitted = 0;
+    std::exception_ptr Error;
+};
+#endif
+} // namespace
+
+std::unique_ptr<IoBackend> CreateIoBackend(const IoOptions& options) {
+    size_t depth = std::max<size_t>(1, options.QueueDepth);
+#ifdef YGGDRA_HAS_IO_URING
+    if (options.Backend == IoBackendKind::IoUring) {
+        auto ring = IoUringBackend::Create(static_cast<unsigned>(std::min<size_t>(depth, 4096)));
+        if (ring) {
+            return ring;
+        }
+    }
+#endif
+    return std::make_unique<ThreadPoolIoBackend>(depth);
+}
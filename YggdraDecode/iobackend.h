@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "fileio.h"
+
+enum class IoBackendKind {
+    ThreadPool, // blocking pread/pwrite on a pool of worker threads
+    IoUring,    // Linux io_uring, falls back to ThreadPool where unavailable
+};
+
+struct IoOptions {
+    // use an IoBackend instead of blocking calls on a File
+    bool Async = false;
+    IoBackendKind Backend = IoBackendKind::IoUring;
+
+    // requests the backend keeps in flight at once
+    size_t QueueDepth = 32;
+
+    // how files are accessed outside of an IoBackend
+    FileBackend Files = FileBackend::Positional;
+};
+
+// Queues positioned reads and writes and calls back once each one has fully completed.
+// Short transfers are continued by the backend; the callback sees either the full length or a
+// negative value on error or end of file.
+// Callbacks may run on any thread, concurrently with each other, and may submit further
+// requests. Exceptions thrown by a callback are rethrown by Drain().
+class IoBackend {
+public:
+    using Callback = std::function<void(int64_t result)>;
+
+    virtual ~IoBackend() = default;
+
+    virtual void SubmitRead(NativeFile file, char* buffer, size_t length, uint64_t offset,
+                            Callback done) = 0;
+    virtual void SubmitWrite(NativeFile file, const char* buffer, size_t length, uint64_t offset,
+                             Callback done) = 0;
+
+    // Returns once every request, including those submitted by callbacks, has completed.
+    virtual void Drain() = 0;
+
+    virtual const char* Name() const = 0;
+};
+
+std::unique_ptr<IoBackend> CreateIoBackend(const IoOptions& options);
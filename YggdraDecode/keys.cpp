@@ -0,0 +1,146 @@
+#include "keys.h"
+
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "md5.h"
+#include "stats.h"
+
+namespace {
+void append_rot13(std::string& s, std::string_view input) {
+    for (char c : input) {
+        if (c >= 'A' && c <= 'Z') {
+            if (c < 'N') {
+                s.push_back(c + 13);
+            } else {
+                s.push_back(c - 13);
+            }
+        } else if (c >= 'a' && c <= 'z') {
+            if (c < 'n') {
+                s.push_back(c + 13);
+            } else {
+                s.push_back(c - 13);
+            }
+        } else {
+            s.push_back(c);
+        }
+    }
+}
+
+std::string rot13(std::string_view input) {
+    std::string s;
+    s.reserve(input.size());
+    append_rot13(s, input);
+    return s;
+}
+
+// Most names fit std::string's small buffer, so a lookup rarely allocates.
+std::shared_mutex CacheMutex;
+std::unordered_map<std::string, CryptKey> Cache;
+
+CryptKey Hash(std::string_view filename) {
+    std::string key = rot13(filename);
+    md5_byte_t digest[16];
+    md5_state_t md5;
+    md5_init(&md5);
+    md5_append(&md5, (const md5_byte_t*)key.data(), static_cast<int>(key.size()));
+    md5_finish(&md5, digest);
+
+    CryptKey result;
+    std::memcpy(result.data(), digest, 16);
+    return result;
+}
+
+std::vector<CryptKey> HashMany(const std::vector<std::string_view>& names) {
+    size_t bytes = 0;
+    for (auto name : names) {
+        bytes += name.size();
+    }
+
+    // the rot13'd names go into one buffer, which is filled before any pointer into it is taken
+    std::string keys;
+    keys.reserve(bytes);
+    std::vector<int> lengths;
+    for (auto name : names) {
+        append_rot13(keys, name);
+        lengths.push_back(static_cast<int>(name.size()));
+    }
+    std::vector<const md5_byte_t*> data;
+    size_t offset = 0;
+    for (int length : lengths) {
+        data.push_back((const md5_byte_t*)keys.data() + offset);
+        offset += length;
+    }
+
+    static_assert(sizeof(CryptKey) == 16, "md5_many writes the digests back to back");
+    std::vector<CryptKey> result(names.size());
+    md5_many(data.data(), lengths.data(), static_cast<int>(names.size()),
+             (md5_byte_t*)result.data());
+    return result;
+}
+} // namespace
+
+CryptKey DeriveKey(std::string_view filename) {
+    {
+        std::shared_lock<std::shared_mutex> lock(CacheMutex);
+        auto it = Cache.find(std::string(filename));
+        if (it != Cache.end()) {
+            return it->second;
+        }
+    }
+
+    CryptKey key;
+    {
+        PhaseTimer timer(StatPhase::KeyDerivation, filename.size(), filename);
+        key = Hash(filename);
+    }
+    // another thread may have got there first, with the same key
+    std::unique_lock<std::shared_mutex> lock(CacheMutex);
+    Cache.emplace(std::string(filename), key);
+    return key;
+}
+
+std::vector<CryptKey> DeriveKeys(const std::vector<std::string_view>& names) {
+    // batches come from loading a file table and are rare, so one exclusive lock covers the
+    // lookups, the hashing and filling in the new entries; each name is looked up once
+    std::unique_lock<std::shared_mutex> lock(CacheMutex);
+
+    std::vector<const CryptKey*> slots;
+    std::vector<CryptKey*> pending;
+    std::vector<std::string_view> toHash;
+    size_t bytes = 0;
+    slots.reserve(names.size());
+    for (auto name : names) {
+        auto [it, inserted] = Cache.try_emplace(std::string(name));
+        if (inserted) {
+            // names repeat within a batch as well; only their first occurrence is hashed
+            pending.push_back(&it->second);
+            toHash.push_back(name);
+            bytes += name.size();
+        }
+        slots.push_back(&it->second);
+    }
+
+    if (!toHash.empty()) {
+        PhaseTimer timer(StatPhase::KeyDerivation, bytes);
+        std::vector<CryptKey> hashed = HashMany(toHash);
+        for (size_t i = 0; i < hashed.size(); ++i) {
+            *pending[i] = hashed[i];
+        }
+    }
+
+    std::vector<CryptKey> result;
+    result.reserve(names.size());
+    for (const CryptKey* key : slots) {
+        result.push_back(*key);
+    }
+    return result;
+}
+
+void ClearKeyCache() {
+    std::unique_lock<std::shared_mutex> lock(CacheMutex);
+    Cache.clear();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// The key a blob is encrypted with: the MD5 digest of the rot13 of its name, as the four
+// little-endian words Crypt XORs with.
+using CryptKey = std::array<uint32_t, 4>;
+
+// Derives keys through a process-wide cache keyed by name, so that a name shared by many entries
+// (index.json, icon.png, ...) costs a lookup after the first time. Safe to call from several
+// threads at once.
+CryptKey DeriveKey(std::string_view filename);
+
+// Keys for a whole batch of names; those not in the cache yet are hashed several at once by
+// md5_many, each distinct name once.
+std::vector<CryptKey> DeriveKeys(const std::vector<std::string_view>& names);
+
+// Empties the cache, e.g. between benchmark runs.
+void ClearKeyCache();
+
+namespace detail {
+constexpr uint32_t Md5Sines[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613,
+    0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193,
+    0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d,
+    0x02441453, 0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+    0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122,
+    0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244,
+    0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb,
+    0xeb86d391,
+};
+
+constexpr int Md5Shifts[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+constexpr uint8_t Rot13(char c) {
+    if ((c >= 'A' && c <= 'M') || (c >= 'a' && c <= 'm')) {
+        return static_cast<uint8_t>(c + 13);
+    }
+    if ((c >= 'N' && c <= 'Z') || (c >= 'n' && c <= 'z')) {
+        return static_cast<uint8_t>(c - 13);
+    }
+    return static_cast<uint8_t>(c);
+}
+
+// Byte i of the padded rot13 message, as md5_finish pads it.
+constexpr uint8_t PaddedByte(std::string_view name, size_t paddedSize, size_t i) {
+    if (i < name.size()) {
+        return Rot13(name[i]);
+    }
+    if (i == name.size()) {
+        return 0x80;
+    }
+    if (i >= paddedSize - 8) {
+        uint64_t bits = static_cast<uint64_t>(name.size()) * 8;
+        return static_cast<uint8_t>(bits >> ((i - (paddedSize - 8)) * 8));
+    }
+    return 0;
+}
+} // namespace detail
+
+// DeriveKey for names known at compile time, written for clarity rather than speed.
+constexpr CryptKey ConstexprKey(std::string_view name) {
+    CryptKey state = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    size_t paddedSize = (name.size() + 8) / 64 * 64 + 64;
+    for (size_t block = 0; block < paddedSize; block += 64) {
+        uint32_t x[16] = {};
+        for (size_t i = 0; i < 64; ++i) {
+            x[i / 4] |= uint32_t(detail::PaddedByte(name, paddedSize, block + i)) << (i % 4 * 8);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        for (size_t i = 0; i < 64; ++i) {
+            uint32_t f = 0;
+            size_t k = 0;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                k = i;
+            } else if (i < 32) {
+                f = (b & d) | (c & ~d);
+                k = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                k = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d);
+                k = (7 * i) % 16;
+            }
+            uint32_t t = a + f + x[k] + detail::Md5Sines[i];
+            int s = detail::Md5Shifts[i / 16 * 4 + i % 4];
+            a = d;
+            d = c;
+            c = b;
+            b += (t << s) | (t >> (32 - s));
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+    return state;
+}
+
+// InfoData is read and written on every run, so its key is worked out by the compiler.
+inline constexpr CryptKey InfoDataKey = ConstexprKey("InfoData");
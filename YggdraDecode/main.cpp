@@ -1,520 +1,384 @@
 #include <algorithm>
-#include <array>
 #include <cstdint>
 #include <cstdio>
-#include <cstring>
+#include <cstdlib>
 #include <filesystem>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "archive.h"
+#include "archivereader.h"
+#include "diff.h"
+#include "fileio.h"
+#include "memstats.h"
+#include "patch.h"
+#include "profile.h"
+#include "stats.h"
+#include "trace.h"
+#include "verify.h"
+
+enum class Command {
+    Default, // unpack an archive or pack a folder
+    Profile, // write an archive's workload profile
+    Verify,  // check an archive without extracting it
+    Diff,    // list what changed between two archives
+    MakePatch,
+    ApplyPatch,
+    Read, // write part of one file to stdout
+};
 
-#include "md5.h"
-#include "zlib.h"
-
-bool case_insensitive_equals(char lhs, char rhs) {
-    const char c0 = (lhs >= 'a' && lhs <= 'z') ? (lhs - ('a' + 'A')) : lhs;
-    const char c1 = (rhs >= 'a' && rhs <= 'z') ? (rhs - ('a' + 'A')) : rhs;
-    return c0 == c1;
-}
-
-bool ends_with_case_insensitive(std::string_view string, std::string_view ending) {
-    if (string.size() < ending.size()) {
-        return true;
-    }
-    for (size_t i = 0; i < ending.size(); ++i) {
-        const char cs = string[string.size() - ending.size() + i];
-        const char ce = ending[i];
-        if (!case_insensitive_equals(cs, ce)) {
-            return false;
-        }
+// "-" is stdin; pipes and other devices that can't seek are read in a single pass.
+std::unique_ptr<File> OpenArchiveInput(const std::string& infilepath, FileBackend backend) {
+    if (infilepath == "-") {
+        return OpenStream(stdin);
     }
-    return true;
-}
-
-std::string rot13(std::string_view input) {
-    std::string s;
-    s.reserve(input.size());
-    for (char c : input) {
-        if (c >= 'A' && c <= 'Z') {
-            if (c < 'N') {
-                s.push_back(c + 13);
-            } else {
-                s.push_back(c - 13);
-            }
-        } else if (c >= 'a' && c <= 'z') {
-            if (c < 'n') {
-                s.push_back(c + 13);
-            } else {
-                s.push_back(c - 13);
-            }
-        } else {
-            s.push_back(c);
+    std::filesystem::path p(infilepath);
+    if (std::filesystem::exists(p) && !std::filesystem::is_regular_file(p)) {
+        if (FILE* stream = fopen(infilepath.c_str(), "rb")) {
+            return OpenStream(stream);
         }
+        return nullptr;
     }
-    return s;
+    return OpenFile(p, FileMode::Read, backend);
 }
 
-void Crypt(char* dst, char* src, size_t length, std::string_view filename) {
-    if ((length % 4) != 0) {
-        throw "length must be divisible by 4";
+// Writes to outpath, or to stdout if that's empty.
+int WriteProfile(File& f, const std::string& outpath) {
+    WorkloadProfile profile = BuildWorkloadProfile(f);
+    if (outpath.empty()) {
+        WriteWorkloadProfile(stdout, profile);
+        return 0;
     }
-
-    std::array<md5_byte_t, 16> digest;
-    std::string key = rot13(filename);
-    md5_state_t md5;
-    md5_init(&md5);
-    md5_append(&md5, (const md5_byte_t*)key.data(), key.size());
-    md5_finish(&md5, digest.data());
-
-    std::array<uint32_t, 4> xorsource;
-    std::memcpy(xorsource.data(), digest.data(), 16);
-
-    for (size_t i = 0; i < length; i += 4) {
-        uint32_t tmp;
-        std::memcpy(&tmp, src + i, 4);
-        tmp ^= xorsource[(i / 4) % 4];
-        std::memcpy(dst + i, &tmp, 4);
+    FILE* out = fopen(outpath.c_str(), "wb");
+    if (!out) {
+        printf("Failed to create %s\n", outpath.c_str());
+        return -1;
     }
+    WriteWorkloadProfile(out, profile);
+    fclose(out);
+    return 0;
 }
 
-std::vector<char> ReadDecrypted(FILE* f, size_t offset, size_t length, std::string_view filename) {
-    _fseeki64(f, offset, SEEK_SET);
-
-    std::vector<char> in_data;
-    in_data.resize(length);
-    fread(in_data.data(), 1, in_data.size(), f);
-
-    std::vector<char> out_data;
-    out_data.resize(in_data.size());
-
-    Crypt(out_data.data(), in_data.data(), in_data.size(), filename);
-
-    return out_data;
+// Compares against the manifest at manifestpath unless that's empty.
+int Verify(File& f, const std::string& manifestpath) {
+    VerifyOptions options;
+    Manifest expected;
+    if (!manifestpath.empty()) {
+        if (!ReadManifest(std::filesystem::path(manifestpath), expected)) {
+            printf("Failed to read manifest %s\n", manifestpath.c_str());
+            return -1;
+        }
+        options.Expected = &expected;
+    }
+    VerifyResult result = VerifyArchive(f, options);
+    PrintVerifyResult(stdout, result);
+    return result.Problems.empty() ? 0 : -1;
 }
 
-std::vector<char> Encrypt(const std::vector<char>& in_data, std::string_view filename) {
-    std::vector<char> input = in_data;
-    while ((input.size() % 4) != 0) {
-        input.push_back(0);
+// Both archives are mapped, so that the blobs can be hashed where they lie.
+int Diff(const std::string& oldpath, const std::string& newpath) {
+    auto oldArchive = OpenFile(std::filesystem::path(oldpath), FileMode::Read, FileBackend::Mmap);
+    auto newArchive = OpenFile(std::filesystem::path(newpath), FileMode::Read, FileBackend::Mmap);
+    if (!oldArchive || !newArchive) {
+        printf("Failed to open %s\n", (oldArchive ? newpath : oldpath).c_str());
+        return -1;
     }
-    std::vector<char> output;
-    output.resize(input.size());
-
-    Crypt(output.data(), input.data(), input.size(), filename);
-
-    return output;
+    ArchiveDiff diff = DiffArchives(*oldArchive, *newArchive);
+    PrintArchiveDiff(stdout, diff);
+    if (!diff.Problems.empty()) {
+        return -1;
+    }
+    return diff.Empty() ? 0 : 1;
 }
 
-std::vector<char> Decompress(const std::vector<char>& out_data) {
-    std::vector<char> decomp_data;
-    uint32_t decompSize;
-    std::memcpy(&decompSize, out_data.data(), 4);
-    decomp_data.resize(decompSize);
-
-    z_stream zs{};
-    inflateInit(&zs);
-
-    zs.avail_in = out_data.size() - 4;
-    zs.next_in = (Bytef*)out_data.data() + 4;
-    zs.avail_out = decomp_data.size();
-    zs.next_out = (Bytef*)decomp_data.data();
-    inflate(&zs, Z_FINISH);
-
-    inflateEnd(&zs);
-
-    return decomp_data;
+int CreatePatchFile(const std::string& patchpath, const std::string& oldpath,
+                    const std::string& newpath) {
+    auto oldArchive = OpenFile(std::filesystem::path(oldpath), FileMode::Read, FileBackend::Mmap);
+    auto newArchive = OpenFile(std::filesystem::path(newpath), FileMode::Read, FileBackend::Mmap);
+    if (!oldArchive || !newArchive) {
+        printf("Failed to open %s\n", (oldArchive ? newpath : oldpath).c_str());
+        return -1;
+    }
+    PrintPatchStats(stdout, CreatePatch(*oldArchive, *newArchive, patchpath));
+    return 0;
 }
 
-std::vector<char> Compress(const std::vector<char>& in_data) {
-    std::vector<char> comp_data;
-    uint32_t decompSize = static_cast<uint32_t>(in_data.size());
-    if (in_data.size() != static_cast<size_t>(decompSize)) {
-        throw "data too long to compress";
+// The patch may come from stdin.
+int ApplyPatchFile(const std::string& patchpath, const std::string& oldpath,
+                   const std::string& outpath) {
+    auto oldArchive =
+        OpenFile(std::filesystem::path(oldpath), FileMode::Read, FileBackend::Positional);
+    auto patch = OpenArchiveInput(patchpath, FileBackend::Positional);
+    if (!oldArchive || !patch) {
+        printf("Failed to open %s\n", (oldArchive ? patchpath : oldpath).c_str());
+        return -1;
     }
-
-    z_stream zs{};
-    deflateInit(&zs, 9);
-
-    auto bound = deflateBound(&zs, decompSize);
-    comp_data.resize(static_cast<size_t>(bound) + 4);
-    std::memcpy(comp_data.data(), &decompSize, 4);
-
-    zs.avail_in = decompSize;
-    zs.next_in = (Bytef*)in_data.data();
-    zs.avail_out = bound;
-    zs.next_out = (Bytef*)comp_data.data() + 4;
-    deflate(&zs, Z_FINISH);
-    auto avail_out = zs.avail_out;
-    deflateEnd(&zs);
-
-    comp_data.resize((static_cast<size_t>(bound) - avail_out) + 4);
-
-
-    return comp_data;
+    try {
+        PrintPatchStats(stdout, ApplyPatch(*oldArchive, *patch, outpath));
+    } catch (const char* error) {
+        // the new archive hasn't been written; outpath is as it was
+        printf("Failed to apply patch: %s\n", error);
+        return -1;
+    }
+    return 0;
 }
 
-struct FileTableEntry {
-    bool Extracted = false;
-    std::string Name;
-
-    uint32_t NameOffset; // offset into the strings section of InfoData
-    uint32_t Length;     // two highest bits are flags
-    uint32_t DataOffset; // offset into the data.bin
-};
-
-void Extract(FILE* f, std::string outfolder, std::vector<FileTableEntry>& fileTable, size_t idx,
-             size_t data_offset) {
-    if (idx >= fileTable.size()) {
-        return;
+// spec is path:offset:length, path being the file's path inside the archive. Goes through the
+// inflate index next to the archive and adds to it; a new one gets span's points, or 1 MiB's.
+int ReadEntry(const std::string& archivepath, const std::string& spec, uint64_t span) {
+    size_t lengthColon = spec.rfind(':');
+    size_t offsetColon = lengthColon == std::string::npos || lengthColon == 0
+                             ? std::string::npos
+                             : spec.rfind(':', lengthColon - 1);
+    if (offsetColon == std::string::npos) {
+        fprintf(stderr, "--read needs path:offset:length\n");
+        return -1;
     }
-    auto& e = fileTable[idx];
-    if (e.Extracted) {
-        return;
+    std::string path = spec.substr(0, offsetColon);
+    uint64_t offset = strtoull(spec.c_str() + offsetColon + 1, nullptr, 10);
+    uint64_t length = strtoull(spec.c_str() + lengthColon + 1, nullptr, 10);
+
+    ReaderOptions options;
+    options.Files = FileBackend::Positional;
+    if (span > 0) {
+        options.IndexSpan = span;
     }
-    e.Extracted = true;
-
-    std::filesystem::create_directories(std::filesystem::path(outfolder));
-
-    size_t size = e.Length & 0x3fff'ffff;
-    bool isFolder = !!(e.Length & 0x8000'0000);
-    bool isCompressed = !!(e.Length & 0x4000'0000);
-    std::string outpath = outfolder + "/" + e.Name;
-
-    if (isFolder) {
-        // printf("Extracting folder: Length: %zu, Name: %s\n", size, e.Name.c_str());
-        size_t folder_offset = e.DataOffset / 12;
-        for (size_t i = 0; i < size; ++i) {
-            Extract(f, outpath, fileTable, folder_offset + i, data_offset);
-        }
-    } else {
-        // printf("Extracting file: Length: %zu, Name: %s, Compressed: %s\n", size, e.Name.c_str(),
-        //        isCompressed ? "yes" : "no");
-        size_t extra_bytes = size & 3;
-        size_t aligned_size = extra_bytes ? (size + 4 - extra_bytes) : size;
-
-        auto data = ReadDecrypted(f, data_offset + e.DataOffset, aligned_size, e.Name);
-        if (isCompressed) {
-            extra_bytes = 0;
-            data = Decompress(data);
-        }
-        FILE* f2 = fopen(outpath.c_str(), "wb");
-        fwrite(data.data(), 1, data.size() - (extra_bytes ? (4 - extra_bytes) : 0), f2);
-        fclose(f2);
+    auto reader = ArchiveReader::Open(std::filesystem::path(archivepath), options);
+    if (!reader) {
+        fprintf(stderr, "Failed to open %s\n", archivepath.c_str());
+        return -1;
+    }
+    const ArchiveEntry* entry = reader->Find(path);
+    if (!entry) {
+        fprintf(stderr, "No file %s in %s\n", path.c_str(), archivepath.c_str());
+        return -1;
     }
-}
-
-int ExtractArchive(FILE* f, const std::string& outfilepath) {
-    const char* filename = "InfoData";
-    uint32_t infodata_filesize = 0;
-    const size_t infodata_offset = 0x8;
-    std::array<char, 8> infodata_info_bytes;
-
-    _fseeki64(f, 0, SEEK_SET);
-    fread(infodata_info_bytes.data(), 1, 8, f);
-
-    std::memcpy(&infodata_filesize, infodata_info_bytes.data(), 4);
-    _fseeki64(f, infodata_offset, SEEK_SET);
-
-    std::vector<char> in_data;
-    in_data.resize(infodata_filesize);
-    fread(in_data.data(), 1, in_data.size(), f);
-
-    std::vector<char> out_data;
-    out_data.resize(in_data.size());
-
-    Crypt(out_data.data(), in_data.data(), in_data.size(), filename);
-
-    std::vector<char> decomp_data = Decompress(out_data);
-
-    //{
-    //    FILE* f3 = fopen((outfilepath + "_InfoData").c_str(), "wb");
-    //    fwrite(decomp_data.data(), 1, decomp_data.size(), f3);
-    //    fclose(f3);
-    //}
-
-    std::vector<FileTableEntry> fileTable;
-    {
-        uint32_t lengthData;
-        uint32_t lengthStrings;
-        std::memcpy(&lengthData, decomp_data.data(), 4);
-        std::memcpy(&lengthStrings, decomp_data.data() + 4, 4);
-
-        size_t offsetData = 8;
-        size_t offsetStrings = offsetData + lengthData;
-        size_t numberOfStrings = 0;
-
-        size_t i = offsetData;
-        while (i < offsetStrings) {
-            auto& e = fileTable.emplace_back();
-            std::memcpy(&e.NameOffset, decomp_data.data() + i, 4);
-            std::memcpy(&e.Length, decomp_data.data() + i + 4, 4);
-            std::memcpy(&e.DataOffset, decomp_data.data() + i + 8, 4);
 
-            const auto read_string = [&]() -> std::string {
-                size_t j = offsetStrings + e.NameOffset;
-                std::string n;
-                while (j < decomp_data.size()) {
-                    if (decomp_data[j] == '\0') {
-                        break;
-                    }
-                    n.push_back(decomp_data[j]);
-                    ++j;
-                }
-                return n;
-            };
-            e.Name = read_string();
-            i += 12;
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::vector<char> buffer(static_cast<size_t>(std::min<uint64_t>(length, 1024 * 1024)));
+    while (length > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+        size_t got = reader->Read(*entry, offset, buffer.data(), chunk);
+        fwrite(buffer.data(), 1, got, stdout);
+        if (got < chunk) {
+            break;
         }
+        offset += got;
+        length -= got;
     }
-
-    for (size_t i = 0; i < fileTable.size(); ++i) {
-        Extract(f, outfilepath, fileTable, i, infodata_offset + infodata_filesize);
+    if (!reader->SaveIndex()) {
+        fprintf(stderr, "Failed to write %s.idx\n", archivepath.c_str());
     }
-
     return 0;
 }
 
-struct PackFileEntryInternal {
-    std::filesystem::path Path;
-    std::string Name;
-    bool IsFolder = false;
-    std::vector<PackFileEntryInternal> Children;
-};
-
-struct PackFileEntry {
-    std::filesystem::path Path;
-    uint64_t Length = 0;
-    uint64_t Offset = 0;
-    std::string Name;
-    bool IsFolder = false;
-
-    bool IsRead = false;
-    bool IsCompressed = false;
-    bool IsEncrypted = false;
-    std::vector<char> Data;
-};
-
-void CollectPackFileEntriesInternal(std::vector<PackFileEntryInternal>& entries,
-                                    const std::filesystem::path& p) {
-    for (const auto& entry : std::filesystem::directory_iterator(p)) {
-        if (entry.is_regular_file()) {
-            entries.emplace_back(
-                PackFileEntryInternal{entry.path(), entry.path().filename().string(), false});
-        } else if (entry.is_directory()) {
-            size_t index = entries.size();
-            auto& d = entries.emplace_back(
-                PackFileEntryInternal{entry.path(), entry.path().filename().string(), true});
-
-            CollectPackFileEntriesInternal(d.Children, entry.path());
+// commandArg is the value of --make-patch=, --apply-patch= or --read=.
+int Run(Command command, std::string infilepath, const std::string& outpath,
+        const std::string& commandArg, const ExtractOptions& extractOptions,
+        const PackOptions& packOptions) {
+    if (command == Command::Default && infilepath == "-" && outpath.empty()) {
+        printf("Unpacking from stdin needs an output folder.\n");
+        return -1;
+    }
 
-            std::stable_sort(d.Children.begin(), d.Children.end(),
-                             [](const PackFileEntryInternal& lhs,
-                                const PackFileEntryInternal& rhs) { return lhs.Name > rhs.Name; });
+    if (command == Command::Diff) {
+        if (outpath.empty()) {
+            printf("Diffing needs two archives.\n");
+            return -1;
         }
+        return Diff(infilepath, outpath);
     }
-}
-
-void FlattenPackFileEntries(std::vector<PackFileEntry>& flat,
-                            const std::vector<PackFileEntryInternal>& entries) {
-    size_t startIndex = flat.size();
-    for (const auto& e : entries) {
-        auto& f = flat.emplace_back();
-        f.Path = e.Path;
-        f.Name = e.Name;
-        f.IsFolder = e.IsFolder;
-    }
-    for (size_t i = 0; i < entries.size(); ++i) {
-        const auto& e = entries[i];
-        auto& f = flat[startIndex + i];
-        if (e.IsFolder) {
-            f.Length = e.Children.size();
-            f.Offset = flat.size();
-            FlattenPackFileEntries(flat, e.Children);
+    if (command == Command::MakePatch || command == Command::ApplyPatch) {
+        if (outpath.empty()) {
+            printf("Patching needs an old and a new archive.\n");
+            return -1;
         }
+        return command == Command::MakePatch ? CreatePatchFile(commandArg, infilepath, outpath)
+                                             : ApplyPatchFile(commandArg, infilepath, outpath);
+    }
+    if (command == Command::Read) {
+        return ReadEntry(infilepath, commandArg, packOptions.IndexSpan);
     }
-}
 
-std::vector<PackFileEntry> CollectPackFileEntries(const std::filesystem::path& p) {
-    std::vector<PackFileEntryInternal> entries;
-    CollectPackFileEntriesInternal(entries, p);
-    std::vector<PackFileEntry> flat;
-    FlattenPackFileEntries(flat, entries);
-    return flat;
-}
+    while (infilepath.size() > 0 && (infilepath.back() == '/' || infilepath.back() == '\\')) {
+        infilepath.pop_back();
+    }
+    if (command == Command::Default && std::filesystem::is_directory(infilepath)) {
+        return PackArchive(infilepath, outpath.empty() ? (infilepath + "_new.bin") : outpath,
+                           packOptions);
+    }
 
-int PackArchive(const std::string& infilepath, const std::string& outfilepath) {
-    FILE* f = fopen(outfilepath.c_str(), "wb");
+    auto f = OpenArchiveInput(infilepath, extractOptions.Io.Files);
     if (!f) {
         return -1;
     }
-
-    std::vector<PackFileEntry> entries = CollectPackFileEntries(std::filesystem::path(infilepath));
-
-    uint64_t totalLength = 0;
-    for (auto& entry : entries) {
-        if (!entry.IsFolder) {
-            bool shouldCompress = !(ends_with_case_insensitive(entry.Name, ".pck")
-                                    || ends_with_case_insensitive(entry.Name, ".webp")
-                                    || ends_with_case_insensitive(entry.Name, ".webm")
-                                    || ends_with_case_insensitive(entry.Name, ".png")
-                                    || ends_with_case_insensitive(entry.Name, ".ogg")
-                                    || ends_with_case_insensitive(entry.Name, ".opus"));
-
-            FILE* f2 = fopen(entry.Path.string().c_str(), "rb");
-            _fseeki64(f2, 0, SEEK_END);
-            auto length = _ftelli64(f2);
-            _fseeki64(f2, 0, SEEK_SET);
-            entry.Data.resize(length);
-            fread(entry.Data.data(), 1, length, f2);
-            fclose(f2);
-
-            entry.IsRead = true;
-            if (shouldCompress) {
-                auto compressed = Compress(entry.Data);
-                if (compressed.size() < entry.Data.size()) {
-                    entry.Data = std::move(compressed);
-                    entry.IsCompressed = true;
-                }
-            }
-
-            entry.Length = entry.Data.size();
-            auto encrypted = Encrypt(entry.Data, entry.Name);
-            entry.Data = std::move(encrypted);
-            entry.IsEncrypted = true;
-
-            uint64_t extraBytes = entry.Length & 3;
-            uint64_t alignedLength = extraBytes ? (entry.Length + 4 - extraBytes) : entry.Length;
-            entry.Offset = totalLength;
-            totalLength += alignedLength;
-        }
+    if (command == Command::Profile) {
+        return WriteProfile(*f, outpath);
     }
+    if (command == Command::Verify) {
+        return Verify(*f, outpath);
+    }
+    return ExtractArchive(*f, outpath.empty() ? (infilepath + ".ex") : outpath, extractOptions);
+}
 
-    struct HeaderEntry {
-        uint32_t NameOffset; // offset into the strings section of InfoData
-        uint32_t Length;     // two highest bits are flags
-        uint32_t DataOffset; // offset into the data.bin
-    };
-    std::vector<HeaderEntry> headerData;
-    std::vector<char> headerStrings;
-    for (size_t i = 0; i < entries.size(); ++i) {
-        const auto& entry = entries[i];
-
-        const auto write_string = [&headerStrings](std::string_view sv) -> size_t {
-            size_t pos = headerStrings.size();
-            for (char c : sv) {
-                headerStrings.push_back(c);
-            }
-            headerStrings.push_back(0);
-            return pos;
-        };
-
-        size_t nameOffset = write_string(entry.Name);
-        uint32_t nameOffset32 = static_cast<uint32_t>(nameOffset);
-        if (nameOffset != static_cast<size_t>(nameOffset32)) {
-            throw "string table too big";
+int main(int argc, char** argv) {
+    ExtractOptions extractOptions;
+    PackOptions packOptions;
+    IoOptions io;
+    Command command = Command::Default;
+    bool stats = false;
+    bool statsJson = false;
+    bool memory = false;
+    std::string tracePath;
+    size_t traceEvents = DefaultTraceEvents;
+    std::string commandArg;
+    int argi = 1;
+    for (; argi < argc; ++argi) {
+        std::string_view arg(argv[argi]);
+        if (arg.substr(0, 2) != "--") {
+            break;
         }
-        uint32_t length = 0;
-        uint32_t dataOffset = 0;
-        if (entry.IsFolder) {
-            if (entry.Length > 0x3fff'ffffu) {
-                throw "too many files in folder";
-            }
-
-            length = static_cast<uint32_t>(entry.Length | 0x8000'0000u);
-            uint64_t dataOffset64 = entry.Offset * 12;
-            dataOffset = static_cast<uint32_t>(dataOffset64);
-            if (dataOffset != static_cast<uint64_t>(dataOffset64)) {
-                throw "file table too big";
-            }
+        if (arg == "--order=table") {
+            extractOptions.Order = ExtractOrder::Table;
+        } else if (arg == "--order=offset") {
+            extractOptions.Order = ExtractOrder::DataOffset;
+        } else if (arg == "--stream") {
+            extractOptions.Stream = true;
+        } else if (arg == "--io=sync") {
+            io.Async = false;
+        } else if (arg == "--io=threads") {
+            io.Async = true;
+            io.Backend = IoBackendKind::ThreadPool;
+        } else if (arg == "--io=uring") {
+            io.Async = true;
+            io.Backend = IoBackendKind::IoUring;
+        } else if (arg.substr(0, 11) == "--io-depth=") {
+            io.QueueDepth = std::max(1, atoi(argv[argi] + 11));
+        } else if (arg == "--preallocate") {
+            extractOptions.Preallocate = true;
+            packOptions.Preallocate = true;
+        } else if (arg == "--unlink-existing") {
+            extractOptions.UnlinkExisting = true;
+        } else if (arg == "--update") {
+            extractOptions.SkipUnchanged = true;
+        } else if (arg.substr(0, 8) == "--since=") {
+            extractOptions.Since = std::string(arg.substr(8));
+        } else if (arg == "--manifest=crc32") {
+            extractOptions.Manifest = ManifestHash::Crc32;
+        } else if (arg == "--manifest=md5") {
+            extractOptions.Manifest = ManifestHash::Md5;
+        } else if (arg == "--files=stdio") {
+            io.Files = FileBackend::Stdio;
+        } else if (arg == "--files=pread") {
+            io.Files = FileBackend::Positional;
+        } else if (arg == "--files=mmap") {
+            io.Files = FileBackend::Mmap;
+        } else if (arg == "--profile") {
+            command = Command::Profile;
+        } else if (arg == "--verify") {
+            command = Command::Verify;
+        } else if (arg == "--diff") {
+            command = Command::Diff;
+        } else if (arg.substr(0, 13) == "--make-patch=") {
+            command = Command::MakePatch;
+            commandArg = std::string(arg.substr(13));
+        } else if (arg.substr(0, 14) == "--apply-patch=") {
+            command = Command::ApplyPatch;
+            commandArg = std::string(arg.substr(14));
+        } else if (arg.substr(0, 7) == "--read=") {
+            command = Command::Read;
+            commandArg = std::string(arg.substr(7));
+        } else if (arg == "--index") {
+            packOptions.IndexSpan = 1024 * 1024;
+        } else if (arg.substr(0, 8) == "--index=") {
+            packOptions.IndexSpan = uint64_t(std::max(1, atoi(argv[argi] + 8))) * 1024 * 1024;
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--stats=json") {
+            stats = true;
+            statsJson = true;
+        } else if (arg == "--memory") {
+            memory = true;
+        } else if (arg == "--trace" && argi + 1 < argc) {
+            tracePath = argv[++argi];
+        } else if (arg.substr(0, 8) == "--trace=") {
+            tracePath = std::string(arg.substr(8));
+        } else if (arg.substr(0, 15) == "--trace-events=") {
+            traceEvents = std::max(1ull, strtoull(argv[argi] + 15, nullptr, 10));
         } else {
-            if (entry.Length > 0x3fff'ffffu) {
-                throw "single file too big";
-            }
-
-            length = static_cast<uint32_t>(entry.Length);
-            if (entry.IsCompressed) {
-                length = length | 0x4000'0000u;
-            }
-            uint64_t dataOffset64 = entry.Offset;
-            dataOffset = static_cast<uint32_t>(dataOffset64);
-            if (dataOffset != static_cast<uint64_t>(dataOffset64)) {
-                throw "combined files too big";
-            }
-        }
-
-        headerData.emplace_back(HeaderEntry{nameOffset32, length, dataOffset});
-    }
-
-    std::vector<char> infodata;
-    size_t infodataLength = 8 + headerData.size() * 12 + headerStrings.size();
-    infodata.resize(infodataLength);
-    uint32_t headerDataLength = headerData.size() * 12;
-    uint32_t headerStringsLength = headerStrings.size();
-    std::memcpy(infodata.data(), &headerDataLength, 4);
-    std::memcpy(infodata.data() + 4, &headerStringsLength, 4);
-    for (size_t i = 0; i < headerData.size(); ++i) {
-        std::memcpy(infodata.data() + 8 + i * 12, &headerData[i].NameOffset, 4);
-        std::memcpy(infodata.data() + 8 + i * 12 + 4, &headerData[i].Length, 4);
-        std::memcpy(infodata.data() + 8 + i * 12 + 8, &headerData[i].DataOffset, 4);
-    }
-    std::memcpy(infodata.data() + 8 + headerData.size() * 12, headerStrings.data(),
-                headerStrings.size());
-
-    auto infodataCompressed = Compress(infodata);
-    size_t infodataCompressedLength = infodataCompressed.size();
-    size_t infodataExtraBytes = infodataCompressedLength & 3;
-    size_t infodataAlignedLength = infodataExtraBytes
-                                       ? (infodataCompressedLength + 4 - infodataExtraBytes)
-                                       : infodataCompressedLength;
-    infodataCompressed.resize(infodataAlignedLength);
-    std::vector<char> infodataEncrypted;
-    infodataEncrypted.resize(infodataCompressed.size());
-    Crypt(infodataEncrypted.data(), infodataCompressed.data(), infodataCompressed.size(),
-          "InfoData");
-
-
-    // header
-    std::array<char, 8> infodata_info_bytes{};
-    uint32_t infodata_filesize = infodataCompressedLength;
-    uint32_t content_filesize = totalLength;
-    std::memcpy(infodata_info_bytes.data(), &infodata_filesize, 4);
-    std::memcpy(infodata_info_bytes.data() + 4, &content_filesize, 4);
-    fwrite(infodata_info_bytes.data(), infodata_info_bytes.size(), 1, f);
-
-    // infodata
-    fwrite(infodataEncrypted.data(), infodataEncrypted.size(), 1, f);
-
-    // files
-    for (auto& entry : entries) {
-        if (!entry.IsFolder) {
-            fwrite(entry.Data.data(), entry.Data.size(), 1, f);
+            printf("Unknown option: %s\n", argv[argi]);
+            return -1;
         }
     }
 
-    fclose(f);
-
-    return 0;
-}
-
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        printf("Usage for unpacking: YggdraDecode file.bin\n");
-        printf("Usage for packing: YggdraDecode folder\n");
+    extractOptions.Io = io;
+    packOptions.Io = io;
+
+    if (argi >= argc) {
+        printf("Usage for unpacking: YggdraDecode [options] file.bin [outfolder]\n");
+        printf("Usage for unpacking from stdin: YggdraDecode [options] - outfolder\n");
+        printf("Usage for packing: YggdraDecode [options] folder [out.bin]\n");
+        printf("Usage for profiling: YggdraDecode --profile file.bin [profile.json]\n");
+        printf("Usage for verifying: YggdraDecode --verify file.bin [outfolder.manifest]\n");
+        printf("Usage for diffing: YggdraDecode --diff old.bin new.bin (exits with 1 if they\n");
+        printf("                   differ)\n");
+        printf("Usage for patching: YggdraDecode --make-patch=update.patch old.bin new.bin\n");
+        printf("                    YggdraDecode --apply-patch=update.patch old.bin new.bin\n");
+        printf("Usage for reading part of a file: YggdraDecode --read=path:offset:length\n");
+        printf("                                  file.bin (to stdout)\n");
+        printf("Options:\n");
+        printf("  --order=table|offset   extract in file table or data.bin order\n");
+        printf("  --stream               read the archive in one pass without seeking\n");
+        printf("  --io=sync|threads|uring  I/O backend (uring falls back to threads)\n");
+        printf("  --io-depth=N           requests kept in flight by the threads/uring backends\n");
+        printf("  --files=stdio|pread|mmap  how files are accessed outside the I/O backend\n");
+        printf("  --preallocate          reserve disk space for each output file up front\n");
+        printf("  --unlink-existing      replace existing output files instead of truncating\n");
+        printf("  --update               leave output files that are already up to date alone\n");
+        printf("  --since=old.bin        extract only files added or changed since old.bin\n");
+        printf("  --manifest=crc32|md5   hash the extracted files into outfolder.manifest\n");
+        printf("  --index[=MiB]          when packing, write out.bin.idx with inflate points\n");
+        printf("                         every MiB (1 by default) for --read\n");
+        printf("  --stats[=json]         report time and bytes per phase when done\n");
+        printf("  --memory               report peak memory and allocations per subsystem\n");
+        printf("  --trace out.json       record every read, crypt, (de)compress and write as\n");
+        printf("                         a Chrome trace\n");
+        printf("  --trace-events=N       events kept per thread before the oldest are\n");
+        printf("                         overwritten (1048576 by default)\n");
         return -1;
     }
 
-    std::string infilepath(argv[1]);
-    while (infilepath.size() > 0 && (infilepath.back() == '/' || infilepath.back() == '\\')) {
-        infilepath.pop_back();
+    std::string infilepath(argv[argi]);
+    std::string outpath(argi + 1 < argc ? argv[argi + 1] : "");
+    if (stats) {
+        EnableStats();
     }
-    FILE* f = fopen(infilepath.c_str(), "rb");
-    if (f) {
-        int rv = ExtractArchive(f, infilepath + ".ex");
-        fclose(f);
-        return rv;
-    } else if (std::filesystem::is_directory(std::filesystem::path(infilepath))) {
-        return PackArchive(infilepath, infilepath + "_new.bin");
+    if (!tracePath.empty()) {
+        EnableTrace(traceEvents);
     }
-
-    return -1;
+    if (memory) {
+        EnableMemoryStats();
+    }
+    int rv = Run(command, infilepath, outpath, commandArg, extractOptions, packOptions);
+    // --read's stdout is the file's bytes
+    FILE* reports = command == Command::Read ? stderr : stdout;
+    if (stats) {
+        PrintStats(reports, statsJson);
+    }
+    if (memory) {
+        PrintMemoryStats(reports);
+    }
+    if (!tracePath.empty() && !WriteTrace(std::filesystem::path(tracePath))) {
+        fprintf(reports, "Failed to write trace to %s\n", tracePath.c_str());
+        rv = -1;
+    }
+    return rv;
 }
@@ -0,0 +1,138 @@
+#include "manifest.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "fileio.h"
+#include "md5.h"
+#include "stats.h"
+#include "zlib.h"
+
+namespace {
+const char* const HashNames[] = {"none", "crc32", "md5"};
+
+constexpr std::string_view Header = "# YggdraDecode manifest ";
+
+std::string ToHex(const unsigned char* bytes, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        hex.push_back(digits[bytes[i] >> 4]);
+        hex.push_back(digits[bytes[i] & 15]);
+    }
+    return hex;
+}
+} // namespace
+
+void Manifest::Add(const std::string& outpath, const char* data, size_t size) {
+    std::string path = outpath;
+    if (path.compare(0, Root.size(), Root) == 0 && path.size() > Root.size()
+        && path[Root.size()] == '/') {
+        path.erase(0, Root.size() + 1);
+    }
+    ManifestEntry e{std::move(path), size, HashContents(Hash, data, size)};
+    std::lock_guard<std::mutex> lock(Mutex);
+    Entries.push_back(std::move(e));
+}
+
+const char* ManifestHashName(ManifestHash hash) {
+    return HashNames[static_cast<size_t>(hash)];
+}
+
+std::string HashContents(ManifestHash hash, const char* data, size_t size) {
+    PhaseTimer timer(StatPhase::Hash, size);
+    switch (hash) {
+    case ManifestHash::None:
+        break;
+    case ManifestHash::Crc32: {
+        uLong crc = crc32_z(crc32_z(0, nullptr, 0), (const Bytef*)data, size);
+        char hex[16];
+        snprintf(hex, sizeof(hex), "%08lx", static_cast<unsigned long>(crc));
+        return hex;
+    }
+    case ManifestHash::Md5: {
+        md5_state_t md5;
+        md5_byte_t digest[16];
+        md5_init(&md5);
+        for (size_t i = 0; i < size; i += 0x4000'0000) {
+            size_t n = std::min<size_t>(size - i, 0x4000'0000);
+            md5_append(&md5, (const md5_byte_t*)data + i, static_cast<int>(n));
+        }
+        md5_finish(&md5, digest);
+        return ToHex(digest, sizeof(digest));
+    }
+    }
+    return {};
+}
+
+bool WriteManifest(const std::filesystem::path& path, Manifest& manifest) {
+    std::sort(manifest.Entries.begin(), manifest.Entries.end(),
+              [](const ManifestEntry& lhs, const ManifestEntry& rhs) {
+                  return lhs.Path < rhs.Path;
+              });
+
+    std::string text(Header);
+    text += ManifestHashName(manifest.Hash);
+    text += '\n';
+    for (const auto& e : manifest.Entries) {
+        text += e.Hash;
+        text += ' ';
+        text += std::to_string(e.Size);
+        text += ' ';
+        text += e.Path;
+        text += '\n';
+    }
+
+    auto f = OpenFile(path, FileMode::Write, FileBackend::Positional);
+    if (!f) {
+        return false;
+    }
+    f->WriteAt(text.data(), text.size(), 0); // throws on failure
+    return true;
+}
+
+bool ReadManifest(const std::filesystem::path& path, Manifest& manifest) {
+    auto f = OpenFile(path, FileMode::Read, FileBackend::Positional);
+    if (!f) {
+        return false;
+    }
+    std::string text(static_cast<size_t>(f->Size()), '\0');
+    text.resize(f->ReadAt(text.data(), text.size(), 0));
+
+    size_t pos = text.find('\n');
+    if (pos == std::string::npos || text.compare(0, Header.size(), Header) != 0) {
+        return false;
+    }
+    std::string_view hash = std::string_view(text).substr(Header.size(), pos - Header.size());
+    if (hash == "crc32") {
+        manifest.Hash = ManifestHash::Crc32;
+    } else if (hash == "md5") {
+        manifest.Hash = ManifestHash::Md5;
+    } else {
+        return false;
+    }
+
+    manifest.Entries.clear();
+    while (++pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string_view line = std::string_view(text).substr(pos, end - pos);
+        size_t hashEnd = line.find(' ');
+        size_t sizeEnd = hashEnd == std::string_view::npos ? hashEnd : line.find(' ', hashEnd + 1);
+        if (sizeEnd == std::string_view::npos) {
+            return false;
+        }
+        std::string size(line.substr(hashEnd + 1, sizeEnd - hashEnd - 1));
+        ManifestEntry e;
+        e.Hash = std::string(line.substr(0, hashEnd));
+        e.Size = std::strtoull(size.c_str(), nullptr, 10);
+        e.Path = std::string(line.substr(sizeEnd + 1));
+        manifest.Entries.push_back(std::move(e));
+        pos = end;
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A list of extracted files with their size and a hash of their contents, hashed while the
+// decoded buffer is still in cache instead of in a second pass over the output tree.
+//
+// The file is text: a "# YggdraDecode manifest <hash>" line, then one "<hash> <size> <path>"
+// line per file, sorted by path. Paths are relative to the output folder and use '/'; they come
+// last so they may contain spaces.
+enum class ManifestHash {
+    None,
+    Crc32, // zlib's crc32_z, 8 hex digits
+    Md5,   // 32 hex digits
+};
+
+struct ManifestEntry {
+    std::string Path;
+    uint64_t Size = 0;
+    std::string Hash; // lowercase hex
+};
+
+struct Manifest {
+    ManifestHash Hash = ManifestHash::None;
+    std::string Root; // the output folder, which Add strips from the paths
+    std::vector<ManifestEntry> Entries;
+
+    // Hashes a file's contents; extraction threads add files concurrently.
+    void Add(const std::string& outpath, const char* data, size_t size);
+
+private:
+    std::mutex Mutex;
+};
+
+const char* ManifestHashName(ManifestHash hash);
+
+// Hex digest of a buffer.
+std::string HashContents(ManifestHash hash, const char* data, size_t size);
+
+// Sorts the entries by path and writes them; false if the file can't be created.
+bool WriteManifest(const std::filesystem::path& path, Manifest& manifest);
+
+// false if the file can't be read or isn't a manifest.
+bool ReadManifest(const std::filesystem::path& path, Manifest& manifest);
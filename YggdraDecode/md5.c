@@ -37,6 +37,9 @@
   <ghost@aladdin.com>.  Other authors are noted in the change history
   that follows (in reverse chronological order):
 
+  2026-10-18 Added a little-endian md5_process without the block copy;
+	added md5_many(), which hashes several messages at once in SIMD
+	lanes.
   2002-04-13 lpd Clarified derivation from RFC 1321; now handles byte order
 	either statically or dynamically; added missing #include <string.h>
 	in library.
@@ -61,6 +64,18 @@
 #  define BYTE_ORDER 0
 #endif
 
+/*
+ * Targets known to be little-endian get the md5_process below that loads
+ * the words straight from the input.  Defining MD5_GENERIC keeps the
+ * original one, e.g. to benchmark against it.
+ */
+#if !defined(ARCH_IS_BIG_ENDIAN) && !defined(MD5_GENERIC)
+#  if defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64) || defined(_M_ARM)\
+      || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#    define MD5_LITTLE_ENDIAN 1
+#  endif
+#endif
+
 #define T_MASK ((md5_word_t)~0)
 #define T1 /* 0xd76aa478 */ (T_MASK ^ 0x28955b87)
 #define T2 /* 0xe8c7b756 */ (T_MASK ^ 0x173848a9)
@@ -128,6 +143,127 @@
 #define T64 /* 0xeb86d391 */ (T_MASK ^ 0x14792c6e)
 
 
+#ifdef MD5_LITTLE_ENDIAN
+
+/* Word k of the block, which needn't be aligned; compilers turn this into a plain load. */
+static md5_word_t
+md5_word_le(const md5_byte_t *data, int k)
+{
+    md5_word_t w;
+
+    memcpy(&w, data + k * 4, 4);
+    return w;
+}
+
+/*
+ * md5_process for CPUs known at compile time to be little-endian: the
+ * message words are loaded where they are used, so there is neither a
+ * copy of the block nor a check of its alignment.  MD5 is bound by the
+ * chain of dependencies through b, so each step first adds what doesn't
+ * depend on b, and the functions are arranged so that as few operations
+ * as possible wait for it; G's two halves never overlap, so it can be
+ * added in two parts.
+ */
+static void
+md5_process(md5_state_t *pms, const md5_byte_t *data /*[64]*/)
+{
+    md5_word_t
+	a = pms->abcd[0], b = pms->abcd[1],
+	c = pms->abcd[2], d = pms->abcd[3];
+
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) (((y) & ~(z)) + ((x) & (z)))
+#define H(x, y, z) ((x) ^ ((y) ^ (z)))
+#define I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define SET(f, a, b, c, d, k, s, Ti)\
+  a += md5_word_le(data, k) + Ti;\
+  a += f(b, c, d);\
+  a = ((a << s) | (a >> (32 - s))) + b
+    /* Round 1. */
+    SET(F, a, b, c, d,  0,  7, T1);
+    SET(F, d, a, b, c,  1, 12, T2);
+    SET(F, c, d, a, b,  2, 17, T3);
+    SET(F, b, c, d, a,  3, 22, T4);
+    SET(F, a, b, c, d,  4,  7, T5);
+    SET(F, d, a, b, c,  5, 12, T6);
+    SET(F, c, d, a, b,  6, 17, T7);
+    SET(F, b, c, d, a,  7, 22, T8);
+    SET(F, a, b, c, d,  8,  7, T9);
+    SET(F, d, a, b, c,  9, 12, T10);
+    SET(F, c, d, a, b, 10, 17, T11);
+    SET(F, b, c, d, a, 11, 22, T12);
+    SET(F, a, b, c, d, 12,  7, T13);
+    SET(F, d, a, b, c, 13, 12, T14);
+    SET(F, c, d, a, b, 14, 17, T15);
+    SET(F, b, c, d, a, 15, 22, T16);
+
+    /* Round 2. */
+    SET(G, a, b, c, d,  1,  5, T17);
+    SET(G, d, a, b, c,  6,  9, T18);
+    SET(G, c, d, a, b, 11, 14, T19);
+    SET(G, b, c, d, a,  0, 20, T20);
+    SET(G, a, b, c, d,  5,  5, T21);
+    SET(G, d, a, b, c, 10,  9, T22);
+    SET(G, c, d, a, b, 15, 14, T23);
+    SET(G, b, c, d, a,  4, 20, T24);
+    SET(G, a, b, c, d,  9,  5, T25);
+    SET(G, d, a, b, c, 14,  9, T26);
+    SET(G, c, d, a, b,  3, 14, T27);
+    SET(G, b, c, d, a,  8, 20, T28);
+    SET(G, a, b, c, d, 13,  5, T29);
+    SET(G, d, a, b, c,  2,  9, T30);
+    SET(G, c, d, a, b,  7, 14, T31);
+    SET(G, b, c, d, a, 12, 20, T32);
+
+    /* Round 3. */
+    SET(H, a, b, c, d,  5,  4, T33);
+    SET(H, d, a, b, c,  8, 11, T34);
+    SET(H, c, d, a, b, 11, 16, T35);
+    SET(H, b, c, d, a, 14, 23, T36);
+    SET(H, a, b, c, d,  1,  4, T37);
+    SET(H, d, a, b, c,  4, 11, T38);
+    SET(H, c, d, a, b,  7, 16, T39);
+    SET(H, b, c, d, a, 10, 23, T40);
+    SET(H, a, b, c, d, 13,  4, T41);
+    SET(H, d, a, b, c,  0, 11, T42);
+    SET(H, c, d, a, b,  3, 16, T43);
+    SET(H, b, c, d, a,  6, 23, T44);
+    SET(H, a, b, c, d,  9,  4, T45);
+    SET(H, d, a, b, c, 12, 11, T46);
+    SET(H, c, d, a, b, 15, 16, T47);
+    SET(H, b, c, d, a,  2, 23, T48);
+
+    /* Round 4. */
+    SET(I, a, b, c, d,  0,  6, T49);
+    SET(I, d, a, b, c,  7, 10, T50);
+    SET(I, c, d, a, b, 14, 15, T51);
+    SET(I, b, c, d, a,  5, 21, T52);
+    SET(I, a, b, c, d, 12,  6, T53);
+    SET(I, d, a, b, c,  3, 10, T54);
+    SET(I, c, d, a, b, 10, 15, T55);
+    SET(I, b, c, d, a,  1, 21, T56);
+    SET(I, a, b, c, d,  8,  6, T57);
+    SET(I, d, a, b, c, 15, 10, T58);
+    SET(I, c, d, a, b,  6, 15, T59);
+    SET(I, b, c, d, a, 13, 21, T60);
+    SET(I, a, b, c, d,  4,  6, T61);
+    SET(I, d, a, b, c, 11, 10, T62);
+    SET(I, c, d, a, b,  2, 15, T63);
+    SET(I, b, c, d, a,  9, 21, T64);
+#undef SET
+#undef F
+#undef G
+#undef H
+#undef I
+
+    pms->abcd[0] += a;
+    pms->abcd[1] += b;
+    pms->abcd[2] += c;
+    pms->abcd[3] += d;
+}
+
+#else /* !MD5_LITTLE_ENDIAN */
+
 static void
 md5_process(md5_state_t *pms, const md5_byte_t *data /*[64]*/)
 {
@@ -309,6 +445,8 @@ md5_process(md5_state_t *pms, const md5_byte_t *data /*[64]*/)
     pms->abcd[3] += d;
 }
 
+#endif /* MD5_LITTLE_ENDIAN */
+
 void
 md5_init(md5_state_t *pms)
 {
@@ -379,3 +517,338 @@ md5_finish(md5_state_t *pms, md5_byte_t digest[16])
     for (i = 0; i < 16; ++i)
 	digest[i] = (md5_byte_t)(pms->abcd[i >> 2] >> ((i & 3) << 3));
 }
+
+/*
+ * Multi-buffer MD5.  md5_many() hashes one message per SIMD lane, 4 lanes
+ * with SSE2 and 8 with AVX2, which pays off for many short messages like
+ * the file names keys are derived from.  A lane that is done with its
+ * message takes the next one, so the messages may differ in length.  The
+ * lanes load little-endian words, so they are only built for x86; other
+ * CPUs hash one message after the other.
+ */
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__)) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define MD5_LANES_X86 1
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#    define MD5_TARGET_AVX2
+#  else
+#    define MD5_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#endif
+
+#define MD5_MAX_LANES 8
+
+#ifdef MD5_LANES_X86
+
+/* The 64 steps of md5_process, for the lane functions below. */
+#define MD5_LANE_STEPS\
+    /* Round 1. */\
+    STEP(FL, a, b, c, d,  0,  7, T1);\
+    STEP(FL, d, a, b, c,  1, 12, T2);\
+    STEP(FL, c, d, a, b,  2, 17, T3);\
+    STEP(FL, b, c, d, a,  3, 22, T4);\
+    STEP(FL, a, b, c, d,  4,  7, T5);\
+    STEP(FL, d, a, b, c,  5, 12, T6);\
+    STEP(FL, c, d, a, b,  6, 17, T7);\
+    STEP(FL, b, c, d, a,  7, 22, T8);\
+    STEP(FL, a, b, c, d,  8,  7, T9);\
+    STEP(FL, d, a, b, c,  9, 12, T10);\
+    STEP(FL, c, d, a, b, 10, 17, T11);\
+    STEP(FL, b, c, d, a, 11, 22, T12);\
+    STEP(FL, a, b, c, d, 12,  7, T13);\
+    STEP(FL, d, a, b, c, 13, 12, T14);\
+    STEP(FL, c, d, a, b, 14, 17, T15);\
+    STEP(FL, b, c, d, a, 15, 22, T16);\
+    /* Round 2. */\
+    STEP(GL, a, b, c, d,  1,  5, T17);\
+    STEP(GL, d, a, b, c,  6,  9, T18);\
+    STEP(GL, c, d, a, b, 11, 14, T19);\
+    STEP(GL, b, c, d, a,  0, 20, T20);\
+    STEP(GL, a, b, c, d,  5,  5, T21);\
+    STEP(GL, d, a, b, c, 10,  9, T22);\
+    STEP(GL, c, d, a, b, 15, 14, T23);\
+    STEP(GL, b, c, d, a,  4, 20, T24);\
+    STEP(GL, a, b, c, d,  9,  5, T25);\
+    STEP(GL, d, a, b, c, 14,  9, T26);\
+    STEP(GL, c, d, a, b,  3, 14, T27);\
+    STEP(GL, b, c, d, a,  8, 20, T28);\
+    STEP(GL, a, b, c, d, 13,  5, T29);\
+    STEP(GL, d, a, b, c,  2,  9, T30);\
+    STEP(GL, c, d, a, b,  7, 14, T31);\
+    STEP(GL, b, c, d, a, 12, 20, T32);\
+    /* Round 3. */\
+    STEP(HL, a, b, c, d,  5,  4, T33);\
+    STEP(HL, d, a, b, c,  8, 11, T34);\
+    STEP(HL, c, d, a, b, 11, 16, T35);\
+    STEP(HL, b, c, d, a, 14, 23, T36);\
+    STEP(HL, a, b, c, d,  1,  4, T37);\
+    STEP(HL, d, a, b, c,  4, 11, T38);\
+    STEP(HL, c, d, a, b,  7, 16, T39);\
+    STEP(HL, b, c, d, a, 10, 23, T40);\
+    STEP(HL, a, b, c, d, 13,  4, T41);\
+    STEP(HL, d, a, b, c,  0, 11, T42);\
+    STEP(HL, c, d, a, b,  3, 16, T43);\
+    STEP(HL, b, c, d, a,  6, 23, T44);\
+    STEP(HL, a, b, c, d,  9,  4, T45);\
+    STEP(HL, d, a, b, c, 12, 11, T46);\
+    STEP(HL, c, d, a, b, 15, 16, T47);\
+    STEP(HL, b, c, d, a,  2, 23, T48);\
+    /* Round 4. */\
+    STEP(IL, a, b, c, d,  0,  6, T49);\
+    STEP(IL, d, a, b, c,  7, 10, T50);\
+    STEP(IL, c, d, a, b, 14, 15, T51);\
+    STEP(IL, b, c, d, a,  5, 21, T52);\
+    STEP(IL, a, b, c, d, 12,  6, T53);\
+    STEP(IL, d, a, b, c,  3, 10, T54);\
+    STEP(IL, c, d, a, b, 10, 15, T55);\
+    STEP(IL, b, c, d, a,  1, 21, T56);\
+    STEP(IL, a, b, c, d,  8,  6, T57);\
+    STEP(IL, d, a, b, c, 15, 10, T58);\
+    STEP(IL, c, d, a, b,  6, 15, T59);\
+    STEP(IL, b, c, d, a, 13, 21, T60);\
+    STEP(IL, a, b, c, d,  4,  6, T61);\
+    STEP(IL, d, a, b, c, 11, 10, T62);\
+    STEP(IL, c, d, a, b,  2, 15, T63);\
+    STEP(IL, b, c, d, a,  9, 21, T64);
+
+/* Word k of a block, read the way md5_process reads it on little-endian CPUs. */
+static md5_word_t
+md5_lane_word(const md5_byte_t *block, int k)
+{
+    md5_word_t w;
+
+    memcpy(&w, block + k * 4, 4);
+    return w;
+}
+
+static void
+md5_process_sse2(md5_word_t state[4][MD5_MAX_LANES],
+		 const md5_byte_t *const blocks[MD5_MAX_LANES])
+{
+    __m128i a = _mm_loadu_si128((const __m128i *)state[0]);
+    __m128i b = _mm_loadu_si128((const __m128i *)state[1]);
+    __m128i c = _mm_loadu_si128((const __m128i *)state[2]);
+    __m128i d = _mm_loadu_si128((const __m128i *)state[3]);
+    __m128i aa = a, bb = b, cc = c, dd = d;
+    __m128i X[16];
+    int k;
+
+    for (k = 0; k < 16; ++k)
+	X[k] = _mm_set_epi32((int)md5_lane_word(blocks[3], k), (int)md5_lane_word(blocks[2], k),
+			     (int)md5_lane_word(blocks[1], k), (int)md5_lane_word(blocks[0], k));
+
+#define FL(x, y, z) _mm_or_si128(_mm_and_si128(x, y), _mm_andnot_si128(x, z))
+#define GL(x, y, z) _mm_or_si128(_mm_and_si128(x, z), _mm_andnot_si128(z, y))
+#define HL(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+#define IL(x, y, z) _mm_xor_si128(y, _mm_or_si128(x, _mm_xor_si128(z, _mm_set1_epi32(-1))))
+#define STEP(f, a, b, c, d, k, s, Ti)\
+  a = _mm_add_epi32(_mm_add_epi32(a, f(b, c, d)), _mm_add_epi32(X[k], _mm_set1_epi32((int)(Ti))));\
+  a = _mm_add_epi32(_mm_or_si128(_mm_slli_epi32(a, s), _mm_srli_epi32(a, 32 - (s))), b)
+    MD5_LANE_STEPS;
+#undef STEP
+#undef FL
+#undef GL
+#undef HL
+#undef IL
+
+    _mm_storeu_si128((__m128i *)state[0], _mm_add_epi32(a, aa));
+    _mm_storeu_si128((__m128i *)state[1], _mm_add_epi32(b, bb));
+    _mm_storeu_si128((__m128i *)state[2], _mm_add_epi32(c, cc));
+    _mm_storeu_si128((__m128i *)state[3], _mm_add_epi32(d, dd));
+}
+
+MD5_TARGET_AVX2 static void
+md5_process_avx2(md5_word_t state[4][MD5_MAX_LANES],
+		 const md5_byte_t *const blocks[MD5_MAX_LANES])
+{
+    __m256i a = _mm256_loadu_si256((const __m256i *)state[0]);
+    __m256i b = _mm256_loadu_si256((const __m256i *)state[1]);
+    __m256i c = _mm256_loadu_si256((const __m256i *)state[2]);
+    __m256i d = _mm256_loadu_si256((const __m256i *)state[3]);
+    __m256i aa = a, bb = b, cc = c, dd = d;
+    __m256i X[16];
+    int k;
+
+    for (k = 0; k < 16; ++k)
+	X[k] = _mm256_set_epi32((int)md5_lane_word(blocks[7], k), (int)md5_lane_word(blocks[6], k),
+				(int)md5_lane_word(blocks[5], k), (int)md5_lane_word(blocks[4], k),
+				(int)md5_lane_word(blocks[3], k), (int)md5_lane_word(blocks[2], k),
+				(int)md5_lane_word(blocks[1], k), (int)md5_lane_word(blocks[0], k));
+
+#define FL(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
+#define GL(x, y, z) _mm256_or_si256(_mm256_and_si256(x, z), _mm256_andnot_si256(z, y))
+#define HL(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define IL(x, y, z)\
+  _mm256_xor_si256(y, _mm256_or_si256(x, _mm256_xor_si256(z, _mm256_set1_epi32(-1))))
+#define STEP(f, a, b, c, d, k, s, Ti)\
+  a = _mm256_add_epi32(_mm256_add_epi32(a, f(b, c, d)),\
+		       _mm256_add_epi32(X[k], _mm256_set1_epi32((int)(Ti))));\
+  a = _mm256_add_epi32(_mm256_or_si256(_mm256_slli_epi32(a, s), _mm256_srli_epi32(a, 32 - (s))), b)
+    MD5_LANE_STEPS;
+#undef STEP
+#undef FL
+#undef GL
+#undef HL
+#undef IL
+
+    _mm256_storeu_si256((__m256i *)state[0], _mm256_add_epi32(a, aa));
+    _mm256_storeu_si256((__m256i *)state[1], _mm256_add_epi32(b, bb));
+    _mm256_storeu_si256((__m256i *)state[2], _mm256_add_epi32(c, cc));
+    _mm256_storeu_si256((__m256i *)state[3], _mm256_add_epi32(d, dd));
+}
+
+static int
+md5_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < 7)
+	return 0;
+    __cpuid(info, 1);
+    /* AVX and OSXSAVE, and the OS saves the ymm registers. */
+    if ((info[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+	return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & 0x20) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif /* MD5_LANES_X86 */
+
+typedef void (*md5_lanes_process_t)(md5_word_t state[4][MD5_MAX_LANES],
+				    const md5_byte_t *const blocks[MD5_MAX_LANES]);
+
+/* The widest lane function this CPU runs, or 0 if there is none. */
+static md5_lanes_process_t
+md5_lanes_process(int *lanes)
+{
+#ifdef MD5_LANES_X86
+    if (md5_has_avx2()) {
+	*lanes = 8;
+	return md5_process_avx2;
+    }
+    *lanes = 4;
+    return md5_process_sse2;
+#else
+    *lanes = 1;
+    return 0;
+#endif
+}
+
+int
+md5_many_lanes(void)
+{
+    int lanes;
+
+    md5_lanes_process(&lanes);
+    return lanes;
+}
+
+typedef struct md5_lane_s {
+    int message;		/* index of the message, -1 if the lane is idle */
+    const md5_byte_t *data;
+    int block;			/* next block */
+    int direct;			/* blocks read straight from the message */
+    int blocks;			/* blocks including the padding */
+    md5_byte_t tail[128];	/* the rest of the message, padded */
+} md5_lane_t;
+
+static void
+md5_lane_start(md5_lane_t *lane, md5_word_t state[4][MD5_MAX_LANES], int i, int message,
+	       const md5_byte_t *data, int nbytes)
+{
+    int rest, length, j;
+
+    if (nbytes < 0)
+	nbytes = 0;
+    rest = nbytes & 63;
+    lane->message = message;
+    lane->data = data;
+    lane->block = 0;
+    lane->direct = nbytes >> 6;
+    lane->blocks = lane->direct + (rest < 56 ? 1 : 2);
+
+    /* Pad as md5_finish does: 0x80, zeros, then the length in bits. */
+    length = (lane->blocks - lane->direct) * 64;
+    memset(lane->tail, 0, length);
+    if (rest)
+	memcpy(lane->tail, data + lane->direct * 64, rest);
+    lane->tail[rest] = 0x80;
+    for (j = 0; j < 4; ++j) {
+	lane->tail[length - 8 + j] = (md5_byte_t)(((md5_word_t)nbytes << 3) >> (j * 8));
+	lane->tail[length - 4 + j] = (md5_byte_t)(((md5_word_t)nbytes >> 29) >> (j * 8));
+    }
+
+    state[0][i] = 0x67452301;
+    state[1][i] = /*0xefcdab89*/ T_MASK ^ 0x10325476;
+    state[2][i] = /*0x98badcfe*/ T_MASK ^ 0x67452301;
+    state[3][i] = 0x10325476;
+}
+
+void
+md5_many(const md5_byte_t *const data[], const int nbytes[], int count, md5_byte_t *digests)
+{
+    static const md5_byte_t idle[64] = {0};
+    md5_lane_t lane[MD5_MAX_LANES];
+    md5_word_t state[4][MD5_MAX_LANES];
+    const md5_byte_t *blocks[MD5_MAX_LANES];
+    int lanes, next = 0, active = 0, i, j;
+    md5_lanes_process_t process = md5_lanes_process(&lanes);
+
+    if (!process || count < 2) {
+	for (i = 0; i < count; ++i) {
+	    md5_state_t md5;
+
+	    md5_init(&md5);
+	    md5_append(&md5, data[i], nbytes[i]);
+	    md5_finish(&md5, digests + i * 16);
+	}
+	return;
+    }
+
+    memset(state, 0, sizeof(state));
+    for (i = 0; i < MD5_MAX_LANES; ++i) {
+	lane[i].message = -1;
+	blocks[i] = idle;
+    }
+    for (i = 0; i < lanes && next < count; ++i, ++next, ++active)
+	md5_lane_start(&lane[i], state, i, next, data[next], nbytes[next]);
+
+    while (active) {
+	for (i = 0; i < lanes; ++i) {
+	    md5_lane_t *l = &lane[i];
+
+	    if (l->message < 0)
+		blocks[i] = idle;
+	    else if (l->block < l->direct)
+		blocks[i] = l->data + l->block * 64;
+	    else
+		blocks[i] = l->tail + (l->block - l->direct) * 64;
+	}
+	process(state, blocks);
+	for (i = 0; i < lanes; ++i) {
+	    md5_lane_t *l = &lane[i];
+
+	    if (l->message < 0 || ++l->block < l->blocks)
+		continue;
+	    /* The lanes only exist on little-endian CPUs. */
+	    for (j = 0; j < 4; ++j)
+		memcpy(digests + l->message * 16 + j * 4, &state[j][i], 4);
+	    if (next < count) {
+		md5_lane_start(l, state, i, next, data[next], nbytes[next]);
+		++next;
+	    } else {
+		l->message = -1;
+		--active;
+	    }
+	}
+    }
+}
@@ -37,6 +37,7 @@
   <ghost@aladdin.com>.  Other authors are noted in the change history
   that follows (in reverse chronological order):
 
+  2026-10-18 Added md5_many() and md5_many_lanes().
   2002-04-13 lpd Removed support for non-ANSI compilers; removed
 	references to Ghostscript; clarified derivation from RFC 1321;
 	now handles byte order either statically or dynamically.
@@ -84,6 +85,15 @@ void md5_append(md5_state_t *pms, const md5_byte_t *data, int nbytes);
 /* Finish the message and return the digest. */
 void md5_finish(md5_state_t *pms, md5_byte_t digest[16]);
 
+/*
+ * Digest count separate messages, writing 16 bytes per message to digests.
+ * Several messages are hashed at once, one per SIMD lane.
+ */
+void md5_many(const md5_byte_t *const data[], const int nbytes[], int count, md5_byte_t *digests);
+
+/* How many messages md5_many() hashes at once on this CPU. */
+int md5_many_lanes(void);
+
 #ifdef __cplusplus
 }  /* end extern "C" */
 #endif
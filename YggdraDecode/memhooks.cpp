@@ -0,0 +1,61 @@
+#include "memstats.h"
+
+#include <new>
+
+// The process-wide allocator, so that --memory counts std containers as well. Only the CLI links
+// this; the library leaves operator new to whoever embeds it. The aligned forms are left to the
+// runtime, which pairs them up on its own.
+namespace {
+void* AllocateOrThrow(size_t size) {
+    for (;;) {
+        if (void* p = CountedAllocate(size)) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+} // namespace
+
+void* operator new(size_t size) {
+    return AllocateOrThrow(size);
+}
+
+void* operator new[](size_t size) {
+    return AllocateOrThrow(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return CountedAllocate(size);
+}
+
+void operator delete(void* p) noexcept {
+    CountedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+    CountedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    CountedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    CountedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    CountedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    CountedFree(p);
+}
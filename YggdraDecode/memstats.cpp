@@ -0,0 +1,219 @@
+#include "memstats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+constexpr size_t SubsystemCount = static_cast<size_t>(MemorySubsystem::Count);
+
+const char* const SubsystemNames[SubsystemCount] = {
+    "other", "file buffers", "zlib state", "file table", "path strings",
+};
+
+// Every block starts with this, so a free knows what to take off the counters. 16 bytes keep
+// the alignment malloc gives.
+struct BlockHeader {
+    uint64_t Size;
+    uint32_t Subsystem;
+    uint32_t Counted; // allocated while accounting was on
+};
+static_assert(sizeof(BlockHeader) == 16, "BlockHeader must keep malloc's alignment");
+
+struct Counters {
+    std::atomic<uint64_t> Live{0};
+    std::atomic<uint64_t> Peak{0};
+    std::atomic<uint64_t> Allocations{0};
+};
+
+std::atomic<bool> Enabled{false};
+Counters Subsystems[SubsystemCount];
+Counters Total;
+
+thread_local MemorySubsystem CurrentSubsystem = MemorySubsystem::Other;
+thread_local uint64_t ThreadAllocations = 0;
+thread_local uint64_t ThreadBytes = 0;
+
+struct EntryRecord {
+    std::string Name;
+    uint64_t Allocations;
+    uint64_t Bytes;
+};
+
+constexpr size_t TopEntryCount = 5;
+
+std::mutex EntryMutex;
+uint64_t EntryCount = 0;
+uint64_t EntryAllocations = 0;
+uint64_t EntryBytes = 0;
+std::vector<EntryRecord> TopEntries; // most allocations first
+
+void Charge(Counters& c, uint64_t size) {
+    uint64_t live = c.Live.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = c.Peak.load(std::memory_order_relaxed);
+    while (live > peak
+           && !c.Peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    c.Allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void* Allocate(size_t size, MemorySubsystem subsystem) noexcept {
+    if (size > SIZE_MAX - sizeof(BlockHeader)) {
+        return nullptr;
+    }
+    auto* h = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + size));
+    if (!h) {
+        return nullptr;
+    }
+    h->Size = size;
+    h->Subsystem = static_cast<uint32_t>(subsystem);
+    h->Counted = 0;
+    if (Enabled.load(std::memory_order_relaxed)) {
+        h->Counted = 1;
+        Charge(Subsystems[h->Subsystem], size);
+        Charge(Total, size);
+        ++ThreadAllocations;
+        ThreadBytes += size;
+    }
+    return h + 1;
+}
+
+void Free(void* p) noexcept {
+    if (!p) {
+        return;
+    }
+    auto* h = static_cast<BlockHeader*>(p) - 1;
+    if (h->Counted) {
+        Subsystems[h->Subsystem].Live.fetch_sub(h->Size, std::memory_order_relaxed);
+        Total.Live.fetch_sub(h->Size, std::memory_order_relaxed);
+    }
+    std::free(h);
+}
+
+double Mebibytes(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+} // namespace
+
+void* CountedAllocate(size_t size) noexcept {
+    return Allocate(size, CurrentSubsystem);
+}
+
+void CountedFree(void* p) noexcept {
+    Free(p);
+}
+
+void EnableMemoryStats() {
+    Enabled.store(true, std::memory_order_relaxed);
+}
+
+bool MemoryStatsEnabled() {
+    return Enabled.load(std::memory_order_relaxed);
+}
+
+MemoryScope::MemoryScope(MemorySubsystem subsystem) : Previous(CurrentSubsystem) {
+    CurrentSubsystem = subsystem;
+}
+
+MemoryScope::~MemoryScope() {
+    CurrentSubsystem = Previous;
+}
+
+MemoryEntryScope::MemoryEntryScope(std::string_view name)
+  : Name(name), Allocations(ThreadAllocations), Bytes(ThreadBytes) {}
+
+MemoryEntryScope::~MemoryEntryScope() {
+    if (!MemoryStatsEnabled()) {
+        return;
+    }
+    uint64_t allocations = ThreadAllocations - Allocations;
+    uint64_t bytes = ThreadBytes - Bytes;
+
+    MemoryScope scope(MemorySubsystem::Other);
+    std::lock_guard<std::mutex> lock(EntryMutex);
+    ++EntryCount;
+    EntryAllocations += allocations;
+    EntryBytes += bytes;
+    if (TopEntries.size() < TopEntryCount || allocations > TopEntries.back().Allocations) {
+        auto pos = std::find_if(TopEntries.begin(), TopEntries.end(), [&](const EntryRecord& r) {
+            return allocations > r.Allocations;
+        });
+        TopEntries.insert(pos, EntryRecord{std::string(Name), allocations, bytes});
+        if (TopEntries.size() > TopEntryCount) {
+            TopEntries.pop_back();
+        }
+    }
+}
+
+void* ZlibAlloc(void* opaque, unsigned items, unsigned size) {
+    (void)opaque;
+    return Allocate(static_cast<size_t>(items) * size, MemorySubsystem::ZlibState);
+}
+
+void ZlibFree(void* opaque, void* address) {
+    (void)opaque;
+    Free(address);
+}
+
+uint64_t PeakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss); // bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+void PrintMemoryStats(FILE* out) {
+    fprintf(out, "peak resident: %.1f MiB\n", Mebibytes(PeakResidentBytes()));
+    fprintf(out, "%-14s %12s %14s %14s\n", "subsystem", "allocations", "peak live MiB",
+            "live MiB");
+    for (size_t i = 0; i < SubsystemCount; ++i) {
+        const auto& c = Subsystems[i];
+        fprintf(out, "%-14s %12llu %14.2f %14.2f\n", SubsystemNames[i],
+                static_cast<unsigned long long>(c.Allocations.load()), Mebibytes(c.Peak.load()),
+                Mebibytes(c.Live.load()));
+    }
+    // the subsystems peak at different times, so their peaks don't add up to the total's
+    fprintf(out, "%-14s %12llu %14.2f %14.2f\n", "total",
+            static_cast<unsigned long long>(Total.Allocations.load()), Mebibytes(Total.Peak.load()),
+            Mebibytes(Total.Live.load()));
+
+    std::lock_guard<std::mutex> lock(EntryMutex);
+    if (EntryCount == 0) {
+        return;
+    }
+    fprintf(out, "entries: %llu, allocations per entry: %.1f, bytes per entry: %.0f\n",
+            static_cast<unsigned long long>(EntryCount),
+            static_cast<double>(EntryAllocations) / EntryCount,
+            static_cast<double>(EntryBytes) / EntryCount);
+    fprintf(out, "most allocations:\n");
+    for (const auto& r : TopEntries) {
+        fprintf(out, "  %8llu allocations %12llu bytes  %s\n",
+                static_cast<unsigned long long>(r.Allocations),
+                static_cast<unsigned long long>(r.Bytes), r.Name.c_str());
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+
+// Opt-in accounting of heap use (--memory). zlib's allocator hooks, and in the CLI the global
+// operator new and delete (see memhooks.cpp), count live bytes against the subsystem the
+// allocating thread is working in, as set by MemoryScope. Allocations made before
+// EnableMemoryStats() aren't counted, nor are their frees. Programs that embed the library keep
+// their own operator new, so only zlib's allocations are counted there.
+enum class MemorySubsystem {
+    Other,
+    FileBuffers, // archive blobs and file contents, compressed or not
+    ZlibState,   // inflate and deflate state and windows
+    FileTable,   // InfoData and the parsed file table
+    PathStrings, // output paths and the input tree of a pack
+    Count
+};
+
+void EnableMemoryStats();
+bool MemoryStatsEnabled();
+
+// Charges the calling thread's allocations to a subsystem while it's alive.
+class MemoryScope {
+public:
+    explicit MemoryScope(MemorySubsystem subsystem);
+    ~MemoryScope();
+
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
+
+private:
+    MemorySubsystem Previous;
+};
+
+// Counts the calling thread's allocations while it's alive and files them under an entry, for
+// the allocations-per-entry part of the report.
+class MemoryEntryScope {
+public:
+    explicit MemoryEntryScope(std::string_view name);
+    ~MemoryEntryScope();
+
+    MemoryEntryScope(const MemoryEntryScope&) = delete;
+    MemoryEntryScope& operator=(const MemoryEntryScope&) = delete;
+
+private:
+    std::string_view Name;
+    uint64_t Allocations;
+    uint64_t Bytes;
+};
+
+// The counting allocator, charged to the calling thread's subsystem; nullptr if out of memory.
+// Blocks from CountedAllocate() must go back through CountedFree().
+void* CountedAllocate(size_t size) noexcept;
+void CountedFree(void* p) noexcept;
+
+// zlib's zalloc and zfree, charged to MemorySubsystem::ZlibState.
+void* ZlibAlloc(void* opaque, unsigned items, unsigned size);
+void ZlibFree(void* opaque, void* address);
+
+// Peak resident set size of the process in bytes, 0 where unknown.
+uint64_t PeakResidentBytes();
+
+void PrintMemoryStats(FILE* out);
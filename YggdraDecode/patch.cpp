@@ -0,0 +1,447 @@
+#include "patch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "archive.h"
+#include "memstats.h"
+#include "stats.h"
+
+namespace {
+constexpr char Magic[8] = {'Y', 'G', 'G', 'P', 'A', 'T', 'C', 'H'};
+constexpr uint32_t Version = 2;
+
+enum PatchOp : uint8_t {
+    End = 0,
+    Copy = 1,   // u64 old offset, u64 length
+    Insert = 2, // u64 length, then the bytes
+};
+
+// an unchanged stretch of a changed blob shorter than this costs less inserted than copied
+constexpr size_t MinCopyLength = 32;
+
+// inserted bytes pass through a buffer of this size, in both directions
+constexpr size_t ChunkSize = 1024 * 1024;
+
+using Digest = std::array<unsigned char, 16>;
+
+size_t StoredSize(const FileTableEntry& e) {
+    return ((e.Length & 0x3fff'ffff) + 3) & ~size_t(3);
+}
+
+// length bytes at offset, in place if the file is mapped and read into buffer otherwise
+const char* View(File& f, uint64_t offset, size_t length, std::vector<char>& buffer) {
+    const char* mapped = f.MappedData();
+    if (mapped && offset + length <= f.Size()) {
+        return mapped + offset;
+    }
+    buffer.resize(length);
+    PhaseTimer timer(StatPhase::Read, length);
+    if (f.ReadAt(buffer.data(), length, offset) != length) {
+        throw "blob runs past the end of the archive";
+    }
+    return buffer.data();
+}
+
+// Writes operations, merging copies of neighbouring ranges and inserts of neighbouring bytes.
+// Inserted bytes are taken from the new archive when the insert is written.
+class PatchWriter {
+public:
+    PatchWriter(File& out, File& newArchive) : Out(out), NewArchive(newArchive) {}
+
+    void Raw(const void* data, size_t size) {
+        PhaseTimer timer(StatPhase::Write, size);
+        Out.WriteAt(data, size, Position);
+        Position += size;
+    }
+
+    void CopyRange(uint64_t oldOffset, uint64_t length) {
+        if (length == 0) {
+            return;
+        }
+        FlushInsert();
+        if (CopyLength > 0 && CopyOffset + CopyLength == oldOffset) {
+            CopyLength += length;
+            return;
+        }
+        FlushCopy();
+        CopyOffset = oldOffset;
+        CopyLength = length;
+    }
+
+    void InsertRange(uint64_t newOffset, uint64_t length) {
+        if (length == 0) {
+            return;
+        }
+        FlushCopy();
+        if (InsertLength > 0 && InsertOffset + InsertLength == newOffset) {
+            InsertLength += length;
+            return;
+        }
+        FlushInsert();
+        InsertOffset = newOffset;
+        InsertLength = length;
+    }
+
+    PatchStats Finish() {
+        FlushCopy();
+        FlushInsert();
+        uint8_t op = End;
+        Raw(&op, 1);
+        Stats.PatchBytes = Position;
+        return Stats;
+    }
+
+private:
+    void FlushCopy() {
+        if (CopyLength == 0) {
+            return;
+        }
+        char op[17];
+        op[0] = Copy;
+        std::memcpy(op + 1, &CopyOffset, 8);
+        std::memcpy(op + 9, &CopyLength, 8);
+        Raw(op, sizeof(op));
+        ++Stats.Copies;
+        Stats.CopiedBytes += CopyLength;
+        CopyLength = 0;
+    }
+
+    void FlushInsert() {
+        if (InsertLength == 0) {
+            return;
+        }
+        char op[9];
+        op[0] = Insert;
+        std::memcpy(op + 1, &InsertLength, 8);
+        Raw(op, sizeof(op));
+        for (uint64_t done = 0; done < InsertLength; done += ChunkSize) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(ChunkSize, InsertLength - done));
+            Raw(View(NewArchive, InsertOffset + done, chunk, Buffer), chunk);
+        }
+        ++Stats.Inserts;
+        Stats.InsertedBytes += InsertLength;
+        InsertLength = 0;
+    }
+
+    File& Out;
+    File& NewArchive;
+    uint64_t Position = 0;
+    uint64_t CopyOffset = 0;
+    uint64_t CopyLength = 0;
+    uint64_t InsertOffset = 0;
+    uint64_t InsertLength = 0;
+    std::vector<char> Buffer;
+    PatchStats Stats;
+};
+
+struct PatchSource {
+    File& Archive;
+    uint64_t DataOffset = 0;
+    std::vector<FileTableEntry> Table{};
+    std::unordered_map<std::string, size_t> Paths{};
+};
+
+void LoadPaths(PatchSource& source) {
+    MemoryScope scope(MemorySubsystem::PathStrings);
+    for (size_t i = 0; i < source.Table.size(); ++i) {
+        CollectFilePaths(source.Paths, "", source.Table, i);
+    }
+}
+
+// Removes an unfinished output file unless told to keep it.
+struct PartialFile {
+    std::filesystem::path Path;
+    bool Keep = false;
+
+    ~PartialFile() {
+        if (!Keep) {
+            std::error_code ec;
+            std::filesystem::remove(Path, ec);
+        }
+    }
+};
+
+class PatchReader {
+public:
+    explicit PatchReader(File& f) : F(f) {}
+
+    void Read(void* buffer, size_t length) {
+        PhaseTimer timer(StatPhase::Read, length);
+        if (F.ReadAt(buffer, length, Position) != length) {
+            throw "truncated patch";
+        }
+        Position += length;
+    }
+
+    template <typename T>
+    T Value() {
+        T value;
+        Read(&value, sizeof(value));
+        return value;
+    }
+
+    uint64_t Position = 0;
+
+private:
+    File& F;
+};
+} // namespace
+
+PatchStats CreatePatch(File& oldArchive, File& newArchive, const std::filesystem::path& patchPath) {
+    PatchSource olds{oldArchive};
+    PatchSource news{newArchive};
+    Digest oldDigest = HashArchivePrefix(oldArchive, olds.DataOffset);
+    Digest newDigest = HashArchivePrefix(newArchive, news.DataOffset);
+    ReadFileTable(oldArchive, olds.Table);
+    ReadFileTable(newArchive, news.Table);
+    LoadPaths(olds);
+    LoadPaths(news);
+
+    // a file moved to another folder keeps its name and so its key and stored bytes
+    std::unordered_multimap<std::string_view, size_t> oldByName;
+    for (size_t i = 0; i < olds.Table.size(); ++i) {
+        if (!(olds.Table[i].Length & 0x8000'0000)) {
+            oldByName.emplace(olds.Table[i].Name, i);
+        }
+    }
+
+    // the new archive is written front to back, so its files are visited in data order
+    std::vector<std::pair<size_t, const std::string*>> files;
+    for (const auto& [path, idx] : news.Paths) {
+        files.emplace_back(idx, &path);
+    }
+    std::sort(files.begin(), files.end(), [&](const auto& lhs, const auto& rhs) {
+        const auto& l = news.Table[lhs.first];
+        const auto& r = news.Table[rhs.first];
+        return l.DataOffset != r.DataOffset ? l.DataOffset < r.DataOffset : lhs.first < rhs.first;
+    });
+
+    auto out = OpenFile(patchPath, FileMode::Write, FileBackend::Positional);
+    if (!out) {
+        throw "failed to create patch";
+    }
+    PatchWriter writer(*out, newArchive);
+    uint64_t oldSize = oldArchive.Size();
+    uint64_t newSize = newArchive.Size();
+    writer.Raw(Magic, sizeof(Magic));
+    writer.Raw(&Version, 4);
+    writer.Raw(&oldSize, 8);
+    writer.Raw(oldDigest.data(), oldDigest.size());
+    writer.Raw(&newSize, 8);
+    writer.Raw(newDigest.data(), newDigest.size());
+
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    std::vector<char> oldBuffer;
+    std::vector<char> newBuffer;
+    uint64_t cursor = 0; // everything before it has been written
+    writer.InsertRange(cursor, news.DataOffset);
+    cursor = news.DataOffset;
+    for (const auto& [idx, path] : files) {
+        const auto& e = news.Table[idx];
+        size_t length = StoredSize(e);
+        uint64_t start = news.DataOffset + e.DataOffset;
+        uint64_t end = start + length;
+        if (end <= cursor) {
+            continue;
+        }
+        if (start < cursor) {
+            // blobs that overlap aren't written by PackArchive; take the rest as it is
+            writer.InsertRange(cursor, end - cursor);
+            cursor = end;
+            continue;
+        }
+        writer.InsertRange(cursor, start - cursor);
+        cursor = end;
+
+        const char* data = View(newArchive, start, length, newBuffer);
+        const auto sameBytes = [&](size_t oldIdx) {
+            const auto& o = olds.Table[oldIdx];
+            return o.Length == e.Length
+                   && std::memcmp(View(oldArchive, olds.DataOffset + o.DataOffset, length,
+                                       oldBuffer),
+                                  data, length)
+                          == 0;
+        };
+
+        auto samePath = olds.Paths.find(*path);
+        if (samePath != olds.Paths.end() && sameBytes(samePath->second)) {
+            writer.CopyRange(olds.DataOffset + olds.Table[samePath->second].DataOffset, length);
+            continue;
+        }
+        bool copied = false;
+        auto [first, last] = oldByName.equal_range(e.Name);
+        for (auto it = first; it != last && !copied; ++it) {
+            if ((samePath == olds.Paths.end() || it->second != samePath->second)
+                && sameBytes(it->second)) {
+                writer.CopyRange(olds.DataOffset + olds.Table[it->second].DataOffset, length);
+                copied = true;
+            }
+        }
+        if (copied) {
+            continue;
+        }
+        if (samePath == olds.Paths.end()) {
+            writer.InsertRange(start, length);
+            continue;
+        }
+
+        // same path, same key: bytes that didn't change encrypt the same, so the blob is compared
+        // with the old one position by position
+        const auto& o = olds.Table[samePath->second];
+        uint64_t oldStart = olds.DataOffset + o.DataOffset;
+        size_t oldLength = StoredSize(o);
+        const char* old = View(oldArchive, oldStart, oldLength, oldBuffer);
+        size_t n = std::min(length, oldLength);
+        size_t i = 0;
+        while (i < n) {
+            size_t j = i;
+            while (j < n && old[j] == data[j]) {
+                ++j;
+            }
+            if (j - i >= MinCopyLength) {
+                writer.CopyRange(oldStart + i, j - i);
+            } else {
+                writer.InsertRange(start + i, j - i);
+            }
+            size_t k = j;
+            while (k < n && old[k] != data[k]) {
+                ++k;
+            }
+            writer.InsertRange(start + j, k - j);
+            i = k;
+        }
+        writer.InsertRange(start + n, length - n);
+    }
+    if (newSize > cursor) {
+        writer.InsertRange(cursor, newSize - cursor);
+    }
+    return writer.Finish();
+}
+
+PatchStats ApplyPatch(File& oldArchive, File& patch, const std::filesystem::path& outPath) {
+    PatchReader reader(patch);
+    char magic[sizeof(Magic)];
+    reader.Read(magic, sizeof(magic));
+    if (std::memcmp(magic, Magic, sizeof(Magic)) != 0) {
+        throw "not a patch";
+    }
+    if (reader.Value<uint32_t>() != Version) {
+        throw "unsupported patch version";
+    }
+    uint64_t oldSize = reader.Value<uint64_t>();
+    Digest oldDigest;
+    reader.Read(oldDigest.data(), oldDigest.size());
+    uint64_t newSize = reader.Value<uint64_t>();
+    Digest newDigest;
+    reader.Read(newDigest.data(), newDigest.size());
+
+    uint64_t oldDataOffset = 0;
+    if (oldArchive.Size() != oldSize || HashArchivePrefix(oldArchive, oldDataOffset) != oldDigest) {
+        throw "patch was made for a different archive";
+    }
+
+    std::filesystem::path partialPath(outPath);
+    partialPath += ".partial";
+    PartialFile partial{partialPath};
+    auto out = OpenFile(partialPath, FileMode::Write, FileBackend::Positional);
+    if (!out) {
+        throw "failed to create output archive";
+    }
+
+    MemoryScope scope(MemorySubsystem::FileBuffers);
+    std::vector<char> buffer(ChunkSize);
+    PatchStats stats;
+    uint64_t position = 0;
+    bool kernelCopy = true;
+    for (;;) {
+        uint8_t op = reader.Value<uint8_t>();
+        if (op == End) {
+            break;
+        }
+        if (op == Copy) {
+            uint64_t offset = reader.Value<uint64_t>();
+            uint64_t length = reader.Value<uint64_t>();
+            if (offset > oldSize || length > oldSize - offset) {
+                throw "patch copies from past the end of the old archive";
+            }
+            if (length > newSize - position) {
+                throw "patch writes past the end of the new archive";
+            }
+            PhaseTimer timer(StatPhase::Write, length);
+            uint64_t done = 0;
+            while (done < length) {
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(length - done, 0x4000'0000));
+                int64_t rv = kernelCopy ? NativeCopyRange(oldArchive.Native(), offset + done,
+                                                          out->Native(), position + done, chunk)
+                                        : -1;
+                if (rv < 0) {
+                    // not supported between these files; stays off for the rest of the patch
+                    kernelCopy = false;
+                    chunk = std::min(chunk, buffer.size());
+                    if (oldArchive.ReadAt(buffer.data(), chunk, offset + done) != chunk) {
+                        throw "old archive ended early";
+                    }
+                    out->WriteAt(buffer.data(), chunk, position + done);
+                    rv = static_cast<int64_t>(chunk);
+                } else if (rv == 0) {
+                    throw "old archive ended early";
+                }
+                done += static_cast<uint64_t>(rv);
+            }
+            position += length;
+            ++stats.Copies;
+            stats.CopiedBytes += length;
+        } else if (op == Insert) {
+            uint64_t length = reader.Value<uint64_t>();
+            if (length > newSize - position) {
+                throw "patch writes past the end of the new archive";
+            }
+            for (uint64_t done = 0; done < length; done += buffer.size()) {
+                size_t chunk =
+                    static_cast<size_t>(std::min<uint64_t>(buffer.size(), length - done));
+                reader.Read(buffer.data(), chunk);
+                PhaseTimer timer(StatPhase::Write, chunk);
+                out->WriteAt(buffer.data(), chunk, position + done);
+            }
+            position += length;
+            ++stats.Inserts;
+            stats.InsertedBytes += length;
+        } else {
+            throw "damaged patch";
+        }
+    }
+    if (position != newSize) {
+        throw "patch ends before the new archive does";
+    }
+    uint64_t newDataOffset = 0;
+    if (out->Size() != newSize || HashArchivePrefix(*out, newDataOffset) != newDigest) {
+        throw "patched archive doesn't match the one the patch was made from";
+    }
+    out.reset();
+    std::error_code ec;
+    std::filesystem::rename(partialPath, outPath, ec);
+    if (ec) {
+        throw "failed to replace output archive";
+    }
+    partial.Keep = true;
+    stats.PatchBytes = reader.Position;
+    return stats;
+}
+
+void PrintPatchStats(FILE* out, const PatchStats& stats) {
+    const auto mebibytes = [](uint64_t bytes) {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    };
+    fprintf(out, "%llu copies, %.1f MiB copied; %llu inserts, %.1f MiB inserted\n",
+            static_cast<unsigned long long>(stats.Copies), mebibytes(stats.CopiedBytes),
+            static_cast<unsigned long long>(stats.Inserts), mebibytes(stats.InsertedBytes));
+    fprintf(out, "patch: %.1f MiB\n", mebibytes(stats.PatchBytes));
+}
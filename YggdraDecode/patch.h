@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+
+#include "fileio.h"
+
+// Patches rebuild a new archive from an old one. A patch is a list of operations that produce the
+// new archive front to back, each either copying a range of the old archive or inserting bytes
+// carried in the patch:
+// - a blob whose stored bytes the old archive has, at the same path or under the same name
+//   elsewhere, is copied;
+// - a changed blob at the same path is encrypted with the same key, so it's compared with the old
+//   one byte by byte, and the unchanged stretches are copied;
+// - everything else, header and InfoData included, is inserted as stored, already compressed and
+//   encrypted.
+// The result is the new archive byte for byte.
+//
+// Layout, little-endian: "YGGPATCH", u32 version, u64 old archive size, the MD5 of the old
+// archive's header and InfoData, u64 new archive size, the MD5 of the new archive's header and
+// InfoData, then the operations, each a u8 kind and its fields: Copy u64 old offset, u64 length;
+// Insert u64 length, the bytes; End.
+struct PatchStats {
+    uint64_t Copies = 0;
+    uint64_t CopiedBytes = 0;
+    uint64_t Inserts = 0;
+    uint64_t InsertedBytes = 0;
+    uint64_t PatchBytes = 0;
+};
+
+// Writes a patch that turns oldArchive into newArchive.
+PatchStats CreatePatch(File& oldArchive, File& newArchive, const std::filesystem::path& patchPath);
+
+// Streams the patch into a new archive at outPath, copying from oldArchive with copy_file_range
+// where the platform has it. Memory use doesn't depend on the archive sizes. The archive is
+// written to outPath + ".partial" and only renamed to outPath once its size and header and
+// InfoData match the ones the patch was made from, so outPath may be the old archive itself where
+// the platform lets an open file be replaced. Throws if the patch was made for another archive or
+// is damaged, leaving outPath alone.
+PatchStats ApplyPatch(File& oldArchive, File& patch, const std::filesystem::path& outPath);
+
+void PrintPatchStats(FILE* out, const PatchStats& stats);
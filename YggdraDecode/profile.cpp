@@ -0,0 +1,128 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "archive.h"
+
+namespace {
+void Count(std::vector<uint64_t>& histogram, size_t index) {
+    if (histogram.size() <= index) {
+        histogram.resize(index + 1);
+    }
+    ++histogram[index];
+}
+
+void WalkEntry(WorkloadProfile& profile, std::vector<FileTableEntry>& fileTable,
+               std::vector<size_t>& files, size_t idx, size_t depth) {
+    if (idx >= fileTable.size() || fileTable[idx].Extracted) {
+        return;
+    }
+    auto& e = fileTable[idx];
+    e.Extracted = true;
+    Count(profile.NameLengths, e.Name.size());
+
+    size_t size = e.Length & 0x3fff'ffff;
+    if (e.Length & 0x8000'0000) {
+        ++profile.Folders;
+        Count(profile.Fanout, ProfileBucket(size));
+        size_t first = e.DataOffset / 12;
+        for (size_t i = 0; i < size; ++i) {
+            WalkEntry(profile, fileTable, files, first + i, depth + 1);
+        }
+    } else {
+        ++profile.Files;
+        Count(profile.Depths, depth);
+        files.push_back(idx);
+    }
+}
+
+void WriteHistogram(FILE* out, const char* name, const std::vector<uint64_t>& histogram) {
+    fprintf(out, "  \"%s\": [", name);
+    for (size_t i = 0; i < histogram.size(); ++i) {
+        fprintf(out, "%s%llu", i > 0 ? ", " : "", static_cast<unsigned long long>(histogram[i]));
+    }
+    fprintf(out, "]");
+}
+} // namespace
+
+size_t ProfileBucket(uint64_t value) {
+    size_t bits = 0;
+    while (value != 0) {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+WorkloadProfile BuildWorkloadProfile(File& f) {
+    std::vector<FileTableEntry> fileTable;
+    uint64_t data_offset = ReadFileTable(f, fileTable);
+
+    WorkloadProfile profile;
+    std::vector<size_t> files;
+    for (size_t i = 0; i < fileTable.size(); ++i) {
+        WalkEntry(profile, fileTable, files, i, 0);
+    }
+
+    // compressed blobs start with their original size; reading just that keeps the contents
+    // unread, and going in data order lets this work on streams
+    std::sort(files.begin(), files.end(), [&](size_t lhs, size_t rhs) {
+        return fileTable[lhs].DataOffset < fileTable[rhs].DataOffset;
+    });
+    for (size_t idx : files) {
+        const auto& e = fileTable[idx];
+        uint64_t stored = e.Length & 0x3fff'ffff;
+        uint64_t original = stored;
+        bool compressed = !!(e.Length & 0x4000'0000);
+        if (compressed && stored >= 4) {
+            char prefix[4];
+            if (f.ReadAt(prefix, 4, data_offset + e.DataOffset) == 4) {
+                Crypt(prefix, prefix, 4, e.Key, e.Name);
+                uint32_t size;
+                std::memcpy(&size, prefix, 4);
+                original = size;
+            }
+        }
+
+        size_t bucket = ProfileBucket(original);
+        if (profile.Sizes.size() <= bucket) {
+            profile.Sizes.resize(bucket + 1);
+        }
+        auto& b = profile.Sizes[bucket];
+        ++b.Files;
+        b.OriginalBytes += original;
+        if (compressed) {
+            ++b.Compressed;
+            b.CompressedBytes += stored;
+            b.CompressedOriginalBytes += original;
+        }
+    }
+    return profile;
+}
+
+void WriteWorkloadProfile(FILE* out, const WorkloadProfile& profile) {
+    fprintf(out, "{\n  \"files\": %llu,\n  \"folders\": %llu,\n  \"sizes\": [\n",
+            static_cast<unsigned long long>(profile.Files),
+            static_cast<unsigned long long>(profile.Folders));
+    for (size_t i = 0; i < profile.Sizes.size(); ++i) {
+        const auto& b = profile.Sizes[i];
+        fprintf(out,
+                "    {\"files\": %llu, \"original_bytes\": %llu, \"compressed\": %llu, "
+                "\"compressed_bytes\": %llu, \"compressed_original_bytes\": %llu}%s\n",
+                static_cast<unsigned long long>(b.Files),
+                static_cast<unsigned long long>(b.OriginalBytes),
+                static_cast<unsigned long long>(b.Compressed),
+                static_cast<unsigned long long>(b.CompressedBytes),
+                static_cast<unsigned long long>(b.CompressedOriginalBytes),
+                i + 1 < profile.Sizes.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    WriteHistogram(out, "fanout", profile.Fanout);
+    fprintf(out, ",\n");
+    WriteHistogram(out, "depths", profile.Depths);
+    fprintf(out, ",\n");
+    WriteHistogram(out, "name_lengths", profile.NameLengths);
+    fprintf(out, "\n}\n");
+}
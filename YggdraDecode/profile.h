@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "fileio.h"
+
+// The shape of an archive without any of its names or contents, for benchmarking with archives
+// that can't be shared. YggdraBench's generator replays it.
+
+// Files whose original size has the same bit length: bucket 0 holds empty files and bucket k
+// sizes from 2^(k-1) up to 2^k - 1.
+struct ProfileSizeBucket {
+    uint64_t Files = 0;
+    uint64_t OriginalBytes = 0;
+
+    // files stored compressed, with their size in the archive and once extracted
+    uint64_t Compressed = 0;
+    uint64_t CompressedBytes = 0;
+    uint64_t CompressedOriginalBytes = 0;
+};
+
+struct WorkloadProfile {
+    uint64_t Files = 0;
+    uint64_t Folders = 0;
+    std::vector<ProfileSizeBucket> Sizes;
+    std::vector<uint64_t> Fanout;      // folders by number of children, in the same bit buckets
+    std::vector<uint64_t> Depths;      // files by how many folders they're nested in
+    std::vector<uint64_t> NameLengths; // entries by name length in bytes
+};
+
+// Bit length bucket of a size, see ProfileSizeBucket.
+size_t ProfileBucket(uint64_t value);
+
+// Reads InfoData and the 4 byte size prefix of each compressed blob, nothing else.
+WorkloadProfile BuildWorkloadProfile(File& f);
+
+void WriteWorkloadProfile(FILE* out, const WorkloadProfile& profile);
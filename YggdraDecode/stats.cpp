@@ -0,0 +1,138 @@
+#include "stats.h"
+
+#include "trace.h"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> StatsActive{false};
+
+namespace {
+constexpr size_t PhaseCount = static_cast<size_t>(StatPhase::Count);
+
+const char* const PhaseNames[PhaseCount] = {
+    "read", "write", "mkdir", "key-derivation", "crypt", "decompress", "compress", "hash",
+};
+
+struct PhaseCounters {
+    uint64_t Nanoseconds = 0;
+    uint64_t Calls = 0;
+    uint64_t Bytes = 0;
+};
+
+struct ThreadStats {
+    std::array<PhaseCounters, PhaseCount> Phases{};
+};
+
+// Threads register on their first recording; the registry owns the counters so that they
+// outlive the threads writing them.
+std::mutex RegistryMutex;
+std::vector<std::unique_ptr<ThreadStats>> Registry;
+uint64_t WallStart = 0;
+
+ThreadStats& LocalStats() {
+    thread_local ThreadStats* local = nullptr;
+    if (!local) {
+        std::lock_guard<std::mutex> lock(RegistryMutex);
+        Registry.push_back(std::make_unique<ThreadStats>());
+        local = Registry.back().get();
+    }
+    return *local;
+}
+
+double Seconds(uint64_t nanoseconds) {
+    return static_cast<double>(nanoseconds) / 1e9;
+}
+
+double MegabytesPerSecond(uint64_t bytes, uint64_t nanoseconds) {
+    if (nanoseconds == 0) {
+        return 0.0;
+    }
+    return (static_cast<double>(bytes) / (1024.0 * 1024.0)) / Seconds(nanoseconds);
+}
+} // namespace
+
+void EnableStats() {
+    WallStart = StatsNow();
+    StatsActive.store(true, std::memory_order_relaxed);
+}
+
+uint64_t StatsNow() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    // never 0, which PhaseTimer uses for "not timing"
+    return static_cast<uint64_t>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(now).count())
+           | 1;
+}
+
+const char* PhaseName(StatPhase phase) {
+    return PhaseNames[static_cast<size_t>(phase)];
+}
+
+void RecordPhase(StatPhase phase, uint64_t nanoseconds, uint64_t bytes) {
+    auto& c = LocalStats().Phases[static_cast<size_t>(phase)];
+    c.Nanoseconds += nanoseconds;
+    c.Calls += 1;
+    c.Bytes += bytes;
+}
+
+void RecordSpan(StatPhase phase, uint64_t start, uint64_t bytes, std::string_view entry) {
+    uint64_t end = StatsNow();
+    if (StatsEnabled()) {
+        RecordPhase(phase, end - start, bytes);
+    }
+    if (TraceActive.load(std::memory_order_relaxed)) {
+        TraceSpan(phase, entry, bytes, start, end);
+    }
+}
+
+void PrintStats(FILE* out, bool json) {
+    uint64_t wall = StatsNow() - WallStart;
+
+    std::array<PhaseCounters, PhaseCount> totals{};
+    size_t threads = 0;
+    {
+        std::lock_guard<std::mutex> lock(RegistryMutex);
+        threads = Registry.size();
+        for (const auto& t : Registry) {
+            for (size_t i = 0; i < PhaseCount; ++i) {
+                totals[i].Nanoseconds += t->Phases[i].Nanoseconds;
+                totals[i].Calls += t->Phases[i].Calls;
+                totals[i].Bytes += t->Phases[i].Bytes;
+            }
+        }
+    }
+
+    if (json) {
+        fprintf(out, "{\n  \"wall_seconds\": %.6f,\n  \"threads\": %zu,\n  \"phases\": {\n",
+                Seconds(wall), threads);
+        for (size_t i = 0; i < PhaseCount; ++i) {
+            const auto& c = totals[i];
+            fprintf(out,
+                    "    \"%s\": {\"calls\": %llu, \"bytes\": %llu, \"seconds\": %.6f, "
+                    "\"mb_per_second\": %.3f}%s\n",
+                    PhaseNames[i], static_cast<unsigned long long>(c.Calls),
+                    static_cast<unsigned long long>(c.Bytes), Seconds(c.Nanoseconds),
+                    MegabytesPerSecond(c.Bytes, c.Nanoseconds), i + 1 < PhaseCount ? "," : "");
+        }
+        fprintf(out, "  }\n}\n");
+        return;
+    }
+
+    // phase times are summed over all threads, so with parallel work they can exceed the wall
+    fprintf(out, "wall time: %.3f s, threads: %zu\n", Seconds(wall), threads);
+    fprintf(out, "%-16s %10s %14s %10s %10s\n", "phase", "calls", "bytes", "seconds", "MB/s");
+    for (size_t i = 0; i < PhaseCount; ++i) {
+        const auto& c = totals[i];
+        if (c.Calls == 0) {
+            continue;
+        }
+        fprintf(out, "%-16s %10llu %14llu %10.3f %10.1f\n", PhaseNames[i],
+                static_cast<unsigned long long>(c.Calls),
+                static_cast<unsigned long long>(c.Bytes), Seconds(c.Nanoseconds),
+                MegabytesPerSecond(c.Bytes, c.Nanoseconds));
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+
+// Where time goes during extract and pack. Each thread counts into its own slots, so recording
+// is a clock read and a few plain adds; the totals are only summed up for the report.
+enum class StatPhase {
+    Read,              // archive and input file reads
+    Write,             // output file and archive writes
+    CreateDirectories, // filesystem metadata for the output tree
+    KeyDerivation,     // rot13 + MD5 of file names not in the key cache yet
+    Crypt,             // the XOR pass of Crypt(), both directions
+    Decompress,
+    Compress,
+    Hash,              // manifest hashes of extracted files
+    Count
+};
+
+extern std::atomic<bool> StatsActive;
+extern std::atomic<bool> TraceActive; // see trace.h
+
+inline bool StatsEnabled() {
+    return StatsActive.load(std::memory_order_relaxed);
+}
+
+// Spans are timed when either the stats or the trace want them.
+inline bool TimingEnabled() {
+    return StatsEnabled() || TraceActive.load(std::memory_order_relaxed);
+}
+
+const char* PhaseName(StatPhase phase);
+
+// Starts counting; the wall clock for the report starts here as well.
+void EnableStats();
+
+uint64_t StatsNow(); // nanoseconds, only meaningful as a difference
+
+void RecordPhase(StatPhase phase, uint64_t nanoseconds, uint64_t bytes);
+
+// Ends a span that began at start, adding it to the stats and the trace, whichever are on.
+// entry names the archive entry the span worked on, if any.
+void RecordSpan(StatPhase phase, uint64_t start, uint64_t bytes, std::string_view entry);
+
+// For spans that don't follow a scope, like an asynchronous request from submission to
+// completion: take a start with StatsStart() and pass it to RecordSince() at the end.
+inline uint64_t StatsStart() {
+    return TimingEnabled() ? StatsNow() : 0;
+}
+
+inline void RecordSince(StatPhase phase, uint64_t start, uint64_t bytes,
+                        std::string_view entry = {}) {
+    if (start != 0) {
+        RecordSpan(phase, start, bytes, entry);
+    }
+}
+
+// Times its own lifetime into a phase. Costs nothing beyond a flag check while stats and trace
+// are off. The entry name isn't copied and has to outlive the timer.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(StatPhase phase, uint64_t bytes = 0, std::string_view entry = {})
+      : Phase(phase), Bytes(bytes), Entry(entry), Start(StatsStart()) {}
+
+    ~PhaseTimer() {
+        RecordSince(Phase, Start, Bytes, Entry);
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    // for when the amount of data is only known at the end
+    void SetBytes(uint64_t bytes) {
+        Bytes = bytes;
+    }
+
+private:
+    StatPhase Phase;
+    uint64_t Bytes;
+    std::string_view Entry;
+    uint64_t Start;
+};
+
+// Prints the per-phase totals. Must not race with threads still recording.
+void PrintStats(FILE* out, bool json);
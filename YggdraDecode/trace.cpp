@@ -0,0 +1,152 @@
+#include "trace.h"
+
+#include "memstats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> TraceActive{false};
+
+namespace {
+// longer entry names are cut short, so recording an event never allocates beyond the ring itself
+constexpr size_t EntryCapacity = 64;
+
+struct TraceEvent {
+    StatPhase Phase;
+    uint64_t Bytes;
+    uint64_t Start;
+    uint64_t End;
+    uint8_t EntryLength;
+    char Entry[EntryCapacity];
+
+    void Set(StatPhase phase, std::string_view entry, uint64_t bytes, uint64_t start,
+             uint64_t end) {
+        Phase = phase;
+        Bytes = bytes;
+        Start = start;
+        End = end;
+        size_t length = std::min(entry.size(), EntryCapacity);
+        // don't split a UTF-8 sequence
+        while (length < entry.size() && length > 0 && (entry[length] & 0xc0) == 0x80) {
+            --length;
+        }
+        EntryLength = static_cast<uint8_t>(length);
+        std::memcpy(Entry, entry.data(), EntryLength);
+    }
+};
+
+// Only the owning thread writes; Head is published with release so the writer of the trace sees
+// complete events.
+struct TraceRing {
+    size_t Thread = 0;
+    std::unique_ptr<TraceEvent[]> Events; // RingCapacity of them
+    std::atomic<uint64_t> Head{0};
+};
+
+std::mutex RegistryMutex;
+std::vector<std::unique_ptr<TraceRing>> Registry;
+uint64_t TraceStart = 0;
+size_t RingCapacity = DefaultTraceEvents;
+
+TraceRing& LocalRing() {
+    thread_local TraceRing* local = nullptr;
+    if (!local) {
+        // events are left uninitialized, so pages the thread never records into aren't touched
+        MemoryScope scope(MemorySubsystem::Other);
+        auto ring = std::make_unique<TraceRing>();
+        ring->Events.reset(new TraceEvent[RingCapacity]);
+        std::lock_guard<std::mutex> lock(RegistryMutex);
+        Registry.push_back(std::move(ring));
+        local = Registry.back().get();
+        local->Thread = Registry.size();
+    }
+    return *local;
+}
+
+void WriteJsonString(FILE* out, std::string_view s) {
+    fputc('"', out);
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            fprintf(out, "\\u%04x", static_cast<unsigned>(c));
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// trace-event timestamps are in microseconds
+double Microseconds(uint64_t nanoseconds) {
+    return static_cast<double>(nanoseconds) / 1e3;
+}
+} // namespace
+
+void EnableTrace(size_t eventsPerThread) {
+    RingCapacity = std::max<size_t>(1, eventsPerThread);
+    TraceStart = StatsNow();
+    TraceActive.store(true, std::memory_order_relaxed);
+}
+
+void TraceSpan(StatPhase phase, std::string_view entry, uint64_t bytes, uint64_t start,
+               uint64_t end) {
+    auto& ring = LocalRing();
+    uint64_t head = ring.Head.load(std::memory_order_relaxed);
+    ring.Events[head % RingCapacity].Set(phase, entry, bytes, start, end);
+    ring.Head.store(head + 1, std::memory_order_release);
+}
+
+bool WriteTrace(const std::filesystem::path& path) {
+    FILE* out = fopen(path.string().c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+
+    uint64_t dropped = 0;
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, "
+                 "\"args\": {\"name\": \"YggdraDecode\"}}");
+    {
+        std::lock_guard<std::mutex> lock(RegistryMutex);
+        for (const auto& ring : Registry) {
+            fprintf(out,
+                    ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, "
+                    "\"args\": {\"name\": \"thread %zu\"}}",
+                    ring->Thread, ring->Thread);
+
+            uint64_t head = ring->Head.load(std::memory_order_acquire);
+            uint64_t count = std::min<uint64_t>(head, RingCapacity);
+            dropped += head - count;
+            // oldest first
+            for (uint64_t i = head - count; i < head; ++i) {
+                const auto& e = ring->Events[i % RingCapacity];
+                // spans started before the trace was enabled are clamped to its start
+                uint64_t start = e.Start > TraceStart ? e.Start - TraceStart : 0;
+                fprintf(out,
+                        ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, "
+                        "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"entry\": ",
+                        PhaseName(e.Phase), ring->Thread, Microseconds(start),
+                        Microseconds(e.End - e.Start));
+                WriteJsonString(out, std::string_view(e.Entry, e.EntryLength));
+                fprintf(out, ", \"bytes\": %llu}}", static_cast<unsigned long long>(e.Bytes));
+            }
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0) {
+        ok = false;
+    }
+    if (dropped > 0) {
+        fprintf(stderr, "trace: %llu oldest events were overwritten\n",
+                static_cast<unsigned long long>(dropped));
+    }
+    return ok;
+}
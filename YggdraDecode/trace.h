@@ -0,0 +1,26 @@
+#pragma once
+
+#include "stats.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+// Records every timed span (see PhaseTimer) as an event in the Chrome trace-event format, so
+// a run can be inspected in chrome://tracing or Perfetto. Each thread appends to its own ring
+// without taking a lock; once a ring is full its oldest events are overwritten. A thread's ring is
+// allocated whole when it records its first event, so recording never allocates or copies.
+
+constexpr size_t DefaultTraceEvents = 1 << 20;
+
+// Starts recording, keeping up to eventsPerThread events per thread; event times are relative to
+// this call. Must come before any thread records.
+void EnableTrace(size_t eventsPerThread = DefaultTraceEvents);
+
+void TraceSpan(StatPhase phase, std::string_view entry, uint64_t bytes, uint64_t start,
+               uint64_t end);
+
+// Writes the recorded events as JSON. Must not race with threads still recording.
+// Returns false if the file can't be written.
+bool WriteTrace(const std::filesystem::path& path);
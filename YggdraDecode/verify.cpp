@@ -0,0 +1,361 @@
+#include "verify.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "archive.h"
+#include "memstats.h"
+#include "stats.h"
+
+namespace {
+constexpr uint32_t FolderFlag = 0x8000'0000;
+constexpr uint32_t CompressedFlag = 0x4000'0000;
+constexpr uint32_t SizeMask = 0x3fff'ffff;
+
+uint64_t AlignedSize(uint64_t size) {
+    return (size + 3) & ~uint64_t(3);
+}
+
+struct ProblemList {
+    std::mutex Mutex;
+    std::vector<std::string> Items;
+
+    void Add(std::string_view where, std::string_view what) {
+        std::string problem(where);
+        problem += ": ";
+        problem += what;
+        std::lock_guard<std::mutex> lock(Mutex);
+        Items.push_back(std::move(problem));
+    }
+};
+
+// Reads the header and InfoData, checks InfoData's layout and parses it. Returns where the data
+// section starts.
+uint64_t CheckInfoData(File& f, std::vector<FileTableEntry>& fileTable, uint32_t& contentSize) {
+    MemoryScope scope(MemorySubsystem::FileTable);
+    const char* filename = "InfoData";
+    char header[8];
+    {
+        PhaseTimer timer(StatPhase::Read, sizeof(header), filename);
+        if (f.ReadAt(header, sizeof(header), 0) != sizeof(header)) {
+            throw "archive shorter than its header";
+        }
+    }
+    uint32_t infodataSize;
+    std::memcpy(&infodataSize, header, 4);
+    std::memcpy(&contentSize, header + 4, 4);
+
+    std::vector<char> infodata(static_cast<size_t>(AlignedSize(infodataSize)));
+    {
+        PhaseTimer timer(StatPhase::Read, infodata.size(), filename);
+        if (f.ReadAt(infodata.data(), infodata.size(), sizeof(header)) != infodata.size()) {
+            throw "runs past the end of the archive";
+        }
+    }
+    Crypt(infodata.data(), infodata.data(), infodata.size(), InfoDataKey, filename);
+    std::vector<char> table = DecompressChecked(infodata.data(), infodataSize, filename);
+
+    if (table.size() < 8) {
+        throw "too short for its section lengths";
+    }
+    uint32_t lengthData;
+    uint32_t lengthStrings;
+    std::memcpy(&lengthData, table.data(), 4);
+    std::memcpy(&lengthStrings, table.data() + 4, 4);
+    if (lengthData % 12 != 0) {
+        throw "file table length isn't a multiple of 12";
+    }
+    if (8 + uint64_t(lengthData) + lengthStrings != table.size()) {
+        throw "section lengths don't add up to its size";
+    }
+    const char* strings = table.data() + 8 + lengthData;
+    for (size_t i = 8; i < 8 + size_t(lengthData); i += 12) {
+        uint32_t nameOffset;
+        std::memcpy(&nameOffset, table.data() + i, 4);
+        if (nameOffset >= lengthStrings
+            || !std::memchr(strings + nameOffset, '\0', lengthStrings - nameOffset)) {
+            throw "a name lies outside the strings section";
+        }
+    }
+
+    ParseFileTable(table, fileTable);
+    return sizeof(header) + infodata.size();
+}
+
+// The range of a folder's children, if it lies within the file table.
+bool FolderChildren(const FileTableEntry& e, size_t tableSize, size_t& first, size_t& count) {
+    first = e.DataOffset / 12;
+    count = e.Length & SizeMask;
+    return e.DataOffset % 12 == 0 && first <= tableSize && count <= tableSize - first;
+}
+
+// Every entry has to be reached from the top level exactly once; a child listed by two folders or
+// a folder inside itself would have extraction write files twice or go round in circles. Returns
+// each entry's path as extraction would write it below the output folder.
+std::vector<std::string> CheckTree(const std::vector<FileTableEntry>& fileTable,
+                                   VerifyResult& result, ProblemList& problems) {
+    size_t n = fileTable.size();
+    std::vector<uint8_t> hasParent(n);
+    for (const auto& e : fileTable) {
+        if (!(e.Length & FolderFlag)) {
+            ++result.Files;
+            continue;
+        }
+        ++result.Folders;
+        size_t first, count;
+        if (!FolderChildren(e, n, first, count)) {
+            problems.Add(e.Name, "folder's children lie outside the file table");
+            continue;
+        }
+        for (size_t i = first; i < first + count; ++i) {
+            if (hasParent[i]) {
+                problems.Add(fileTable[i].Name, "listed by more than one folder");
+            }
+            hasParent[i] = 1;
+        }
+    }
+
+    // iterative, as folders can be nested arbitrarily deep
+    std::vector<std::string> paths(n);
+    std::vector<uint8_t> reached(n);
+    std::vector<size_t> stack;
+    for (size_t i = 0; i < n; ++i) {
+        if (!hasParent[i]) {
+            reached[i] = 1;
+            paths[i] = fileTable[i].Name;
+            stack.push_back(i);
+        }
+    }
+    while (!stack.empty()) {
+        size_t idx = stack.back();
+        stack.pop_back();
+        const auto& e = fileTable[idx];
+        size_t first, count;
+        if (!(e.Length & FolderFlag) || !FolderChildren(e, n, first, count)) {
+            continue;
+        }
+        for (size_t i = first; i < first + count; ++i) {
+            if (!reached[i]) {
+                reached[i] = 1;
+                paths[i] = paths[idx] + "/" + fileTable[i].Name;
+                stack.push_back(i);
+            }
+        }
+    }
+
+    // entries that all have a parent but can't be reached from the top are in or below a cycle
+    for (size_t i = 0; i < n; ++i) {
+        if (!reached[i]) {
+            problems.Add(fileTable[i].Name, "unreachable from the top level, folders form a cycle");
+            paths[i] = fileTable[i].Name;
+        }
+    }
+    return paths;
+}
+
+double Mebibytes(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+} // namespace
+
+VerifyResult VerifyArchive(File& f, const VerifyOptions& options) {
+    auto start = std::chrono::steady_clock::now();
+    VerifyResult result;
+    ProblemList problems;
+    const auto finish = [&]() {
+        std::sort(problems.Items.begin(), problems.Items.end());
+        result.Problems = std::move(problems.Items);
+        result.Seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return std::move(result);
+    };
+
+    std::vector<FileTableEntry> fileTable;
+    uint32_t contentSize = 0;
+    uint64_t dataOffset = 0;
+    try {
+        dataOffset = CheckInfoData(f, fileTable, contentSize);
+    } catch (const char* error) {
+        problems.Add("InfoData", error);
+        return finish();
+    }
+    if (f.IsSeekable() && f.Size() < dataOffset + contentSize) {
+        problems.Add("header", "data section runs past the end of the archive");
+    }
+
+    std::vector<std::string> paths = CheckTree(fileTable, result, problems);
+
+    // blobs are checked in data order, which keeps the reads sequential and works on streams
+    std::vector<size_t> files;
+    for (size_t i = 0; i < fileTable.size(); ++i) {
+        const auto& e = fileTable[i];
+        if (e.Length & FolderFlag) {
+            continue;
+        }
+        if (e.DataOffset + AlignedSize(e.Length & SizeMask) > contentSize) {
+            problems.Add(paths[i], "data lies outside the data section");
+            continue;
+        }
+        files.push_back(i);
+    }
+    std::stable_sort(files.begin(), files.end(), [&](size_t lhs, size_t rhs) {
+        return fileTable[lhs].DataOffset < fileTable[rhs].DataOffset;
+    });
+
+    const Manifest* expected = options.Expected;
+    std::vector<std::string> hashes(expected ? fileTable.size() : 0);
+    std::vector<uint64_t> sizes(expected ? fileTable.size() : 0);
+    std::vector<uint8_t> decoded(fileTable.size());
+
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> storedBytes{0};
+    std::atomic<uint64_t> decodedBytes{0};
+    const auto work = [&]() {
+        MemoryScope scope(MemorySubsystem::FileBuffers);
+        std::vector<char> data;
+        for (size_t k; (k = next.fetch_add(1, std::memory_order_relaxed)) < files.size();) {
+            size_t idx = files[k];
+            const auto& e = fileTable[idx];
+            MemoryEntryScope entry(e.Name);
+            size_t size = e.Length & SizeMask;
+            try {
+                data.resize(static_cast<size_t>(AlignedSize(size)));
+                {
+                    PhaseTimer timer(StatPhase::Read, data.size(), e.Name);
+                    if (f.ReadAt(data.data(), data.size(), dataOffset + e.DataOffset)
+                        != data.size()) {
+                        throw "data runs past the end of the archive";
+                    }
+                }
+                storedBytes.fetch_add(data.size(), std::memory_order_relaxed);
+                Crypt(data.data(), data.data(), data.size(), e.Key, e.Name);
+
+                const char* contents = data.data();
+                size_t length = size;
+                std::vector<char> inflated;
+                if (e.Length & CompressedFlag) {
+                    inflated = DecompressChecked(data.data(), size, e.Name);
+                    contents = inflated.data();
+                    length = inflated.size();
+                }
+                decodedBytes.fetch_add(length, std::memory_order_relaxed);
+                if (expected) {
+                    hashes[idx] = HashContents(expected->Hash, contents, length);
+                    sizes[idx] = length;
+                }
+                decoded[idx] = 1;
+            } catch (const char* error) {
+                problems.Add(paths[idx], error);
+            } catch (const std::bad_alloc&) {
+                problems.Add(paths[idx], "out of memory decoding it");
+            } catch (const std::exception& error) {
+                problems.Add(paths[idx], error.what());
+            }
+        }
+    };
+
+    size_t threads = options.Threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (!f.IsSeekable()) {
+        threads = 1;
+    }
+    threads = std::max<size_t>(1, std::min(threads, files.size()));
+    {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < threads; ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
+    result.Threads = threads;
+    result.StoredBytes = storedBytes.load();
+    result.DecodedBytes = decodedBytes.load();
+
+    if (expected) {
+        std::unordered_map<std::string_view, const ManifestEntry*> listed;
+        for (const auto& m : expected->Entries) {
+            listed.emplace(m.Path, &m);
+        }
+        for (size_t i = 0; i < fileTable.size(); ++i) {
+            if (fileTable[i].Length & FolderFlag) {
+                continue;
+            }
+            auto it = listed.find(paths[i]);
+            if (it == listed.end()) {
+                problems.Add(paths[i], "not in the manifest");
+                continue;
+            }
+            // files that failed to decode have been reported already
+            if (decoded[i]) {
+                if (sizes[i] != it->second->Size) {
+                    problems.Add(paths[i], "size differs from the manifest");
+                } else if (hashes[i] != it->second->Hash) {
+                    problems.Add(paths[i], "contents differ from the manifest");
+                }
+            }
+            listed.erase(it);
+        }
+        for (const auto& [path, m] : listed) {
+            problems.Add(path, "in the manifest but not in the archive");
+        }
+    }
+
+    return finish();
+}
+
+uint64_t ReadCheckedFileTable(File& f, std::vector<FileTableEntry>& fileTable,
+                              std::vector<std::string>& paths) {
+    uint32_t contentSize = 0;
+    uint64_t dataOffset = CheckInfoData(f, fileTable, contentSize);
+    if (f.Size() < dataOffset + contentSize) {
+        throw "data section runs past the end of the archive";
+    }
+    VerifyResult result;
+    ProblemList problems;
+    paths = CheckTree(fileTable, result, problems);
+    if (!problems.Items.empty()) {
+        throw "folders in the file table don't form a tree";
+    }
+    for (const auto& e : fileTable) {
+        if (!(e.Length & FolderFlag)
+            && e.DataOffset + AlignedSize(e.Length & SizeMask) > contentSize) {
+            throw "a file's data lies outside the data section";
+        }
+    }
+    return dataOffset;
+}
+
+void PrintVerifyResult(FILE* out, const VerifyResult& result) {
+    fprintf(out, "%llu files in %llu folders, %.1f MiB stored, %.1f MiB decoded\n",
+            static_cast<unsigned long long>(result.Files),
+            static_cast<unsigned long long>(result.Folders), Mebibytes(result.StoredBytes),
+            Mebibytes(result.DecodedBytes));
+    if (result.Threads > 0) {
+        double seconds = std::max(result.Seconds, 1e-9);
+        fprintf(out, "%.3f s on %zu threads, %.1f MiB/s stored, %.1f MiB/s decoded\n",
+                result.Seconds, result.Threads, Mebibytes(result.StoredBytes) / seconds,
+                Mebibytes(result.DecodedBytes) / seconds);
+    }
+    for (const auto& problem : result.Problems) {
+        fprintf(out, "%s\n", problem.c_str());
+    }
+    if (result.Problems.empty()) {
+        fprintf(out, "OK\n");
+    } else {
+        fprintf(out, "%zu problem%s\n", result.Problems.size(),
+                result.Problems.size() == 1 ? "" : "s");
+    }
+}
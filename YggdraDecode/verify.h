@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+#include "manifest.h"
+
+struct FileTableEntry;
+
+// Checks a whole archive without writing anything: that InfoData inflates cleanly and its
+// sections add up, that folder ranges are in bounds and form a tree, that every blob lies in the
+// data section and that every compressed blob inflates to exactly its size with a good Adler-32.
+// Blobs are checked on all cores.
+struct VerifyOptions {
+    size_t Threads = 0; // 0 for one per core; streams are always read by one
+
+    // compare each file's size and hash with this, and report files missing on either side
+    const Manifest* Expected = nullptr;
+};
+
+struct VerifyResult {
+    uint64_t Files = 0;
+    uint64_t Folders = 0;
+    uint64_t StoredBytes = 0;  // blob bytes read from the archive
+    uint64_t DecodedBytes = 0; // the same files once decrypted and inflated
+    size_t Threads = 0;
+    double Seconds = 0.0;
+    std::vector<std::string> Problems;
+};
+
+VerifyResult VerifyArchive(File& f, const VerifyOptions& options);
+
+// The checks VerifyArchive() makes of the header, InfoData, folder tree and blob ranges, without
+// reading any blobs, for opening archives that may be damaged. Fills fileTable and each entry's
+// '/'-separated path, and returns where the data section starts. Throws at the first problem.
+uint64_t ReadCheckedFileTable(File& f, std::vector<FileTableEntry>& fileTable,
+                              std::vector<std::string>& paths);
+
+void PrintVerifyResult(FILE* out, const VerifyResult& result);
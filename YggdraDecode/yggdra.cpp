@@ -0,0 +1,125 @@
+#include "yggdra.h"
+
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "archivereader.h"
+
+struct ygg_archive {
+    std::unique_ptr<ArchiveReader> Reader;
+};
+
+namespace {
+thread_local std::string LastError;
+
+ygg_result Fail(ygg_result result, const char* message) {
+    LastError = message;
+    return result;
+}
+
+// Runs f, turning whatever it throws into an error code; the library throws string literals.
+template <typename F>
+ygg_result Guard(F&& f) {
+    try {
+        return f();
+    } catch (const char* message) {
+        return Fail(YGG_ERROR_ARCHIVE, message);
+    } catch (const std::bad_alloc&) {
+        return Fail(YGG_ERROR_OUT_OF_MEMORY, "out of memory");
+    } catch (const std::exception& e) {
+        return Fail(YGG_ERROR_INTERNAL, e.what());
+    } catch (...) {
+        return Fail(YGG_ERROR_INTERNAL, "unknown error");
+    }
+}
+
+const ArchiveEntry* Entry(const ygg_archive* archive, size_t index) {
+    if (!archive || index >= archive->Reader->Entries().size()) {
+        return nullptr;
+    }
+    return &archive->Reader->Entries()[index];
+}
+} // namespace
+
+ygg_result ygg_open(const char* path, ygg_archive** archive) {
+    if (!path || !archive) {
+        return Fail(YGG_ERROR_INVALID_ARGUMENT, "null argument");
+    }
+    *archive = nullptr;
+    return Guard([&]() {
+        auto reader = ArchiveReader::Open(std::filesystem::u8path(path));
+        if (!reader) {
+            return Fail(YGG_ERROR_OPEN, "failed to open archive");
+        }
+        *archive = new ygg_archive{std::move(reader)};
+        return YGG_OK;
+    });
+}
+
+void ygg_close(ygg_archive* archive) {
+    delete archive;
+}
+
+size_t ygg_entry_count(const ygg_archive* archive) {
+    return archive ? archive->Reader->Entries().size() : 0;
+}
+
+const char* ygg_entry_path(const ygg_archive* archive, size_t index) {
+    const ArchiveEntry* entry = Entry(archive, index);
+    return entry ? entry->Path.c_str() : nullptr;
+}
+
+ygg_result ygg_entry_size(ygg_archive* archive, size_t index, uint64_t* size) {
+    const ArchiveEntry* entry = Entry(archive, index);
+    if (!entry || !size) {
+        return Fail(YGG_ERROR_INVALID_ARGUMENT, "no such entry, or null argument");
+    }
+    return Guard([&]() {
+        *size = archive->Reader->Size(*entry);
+        return YGG_OK;
+    });
+}
+
+ygg_result ygg_find(const ygg_archive* archive, const char* path, size_t* index) {
+    if (!archive || !path || !index) {
+        return Fail(YGG_ERROR_INVALID_ARGUMENT, "null argument");
+    }
+    return Guard([&]() {
+        const ArchiveEntry* entry = archive->Reader->Find(path);
+        if (!entry) {
+            return Fail(YGG_ERROR_NOT_FOUND, "no file at that path");
+        }
+        *index = static_cast<size_t>(entry - archive->Reader->Entries().data());
+        return YGG_OK;
+    });
+}
+
+ygg_result ygg_read(ygg_archive* archive, size_t index, uint64_t offset, void* buffer,
+                    size_t length, size_t* bytes_read) {
+    const ArchiveEntry* entry = Entry(archive, index);
+    if (!entry || (!buffer && length > 0) || !bytes_read) {
+        return Fail(YGG_ERROR_INVALID_ARGUMENT, "no such entry, or null argument");
+    }
+    *bytes_read = 0;
+    return Guard([&]() {
+        *bytes_read = archive->Reader->Read(*entry, offset, static_cast<char*>(buffer), length);
+        return YGG_OK;
+    });
+}
+
+ygg_result ygg_save_index(ygg_archive* archive) {
+    if (!archive) {
+        return Fail(YGG_ERROR_INVALID_ARGUMENT, "null argument");
+    }
+    return Guard([&]() {
+        return archive->Reader->SaveIndex() ? YGG_OK
+                                            : Fail(YGG_ERROR_OPEN, "failed to write inflate index");
+    });
+}
+
+const char* ygg_last_error(void) {
+    return LastError.c_str();
+}
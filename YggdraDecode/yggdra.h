@@ -0,0 +1,68 @@
+#ifndef YGGDRA_H
+#define YGGDRA_H
+
+/* A C interface to ArchiveReader, for reading archives in-process from other languages and tools.
+ * Archives are opaque handles; every function but ygg_close() may be called on the same handle
+ * from several threads at once. Functions report errors through their return value, never by
+ * throwing, and ygg_last_error() describes the calling thread's last failure. Strings are UTF-8,
+ * and paths inside an archive are '/'-separated. Define YGG_API to export the functions when
+ * building them into a shared library. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef YGG_API
+#define YGG_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ygg_archive ygg_archive;
+
+typedef enum ygg_result {
+    YGG_OK = 0,
+    YGG_ERROR_INVALID_ARGUMENT = 1, /* a null pointer or an entry index out of range */
+    YGG_ERROR_NOT_FOUND = 2,        /* no file at that path */
+    YGG_ERROR_OPEN = 3,             /* the archive file can't be opened */
+    YGG_ERROR_ARCHIVE = 4,          /* not an archive, damaged, or failed to read */
+    YGG_ERROR_OUT_OF_MEMORY = 5,
+    YGG_ERROR_INTERNAL = 6,
+} ygg_result;
+
+/* Opens the archive at path and stores the handle in *archive. Picks up the inflate index next
+ * to the archive, path + ".idx", if there is one. */
+YGG_API ygg_result ygg_open(const char* path, ygg_archive** archive);
+
+/* Closes the archive. Null does nothing. */
+YGG_API void ygg_close(ygg_archive* archive);
+
+/* Entries are the archive's files, by index from 0 to the count, in path order. */
+YGG_API size_t ygg_entry_count(const ygg_archive* archive);
+
+/* Null if index is out of range. The string lives as long as the archive. */
+YGG_API const char* ygg_entry_path(const ygg_archive* archive, size_t index);
+
+/* The number of bytes the entry reads as. */
+YGG_API ygg_result ygg_entry_size(ygg_archive* archive, size_t index, uint64_t* size);
+
+YGG_API ygg_result ygg_find(const ygg_archive* archive, const char* path, size_t* index);
+
+/* Reads up to length bytes at offset of an entry into buffer, and how many there were into
+ * *bytes_read; fewer than length only at the end of the entry. Big compressed entries are inflated
+ * from the closest access point; the first read of one makes its points. */
+YGG_API ygg_result ygg_read(ygg_archive* archive, size_t index, uint64_t offset, void* buffer,
+                            size_t length, size_t* bytes_read);
+
+/* Writes the access points reads have made to the inflate index next to the archive. */
+YGG_API ygg_result ygg_save_index(ygg_archive* archive);
+
+/* What went wrong in the calling thread's last failed call, "" if none has. */
+YGG_API const char* ygg_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* YGGDRA_H */